@@ -32,12 +32,18 @@ typedef struct InputPath InputPath;
 typedef struct InputRegion InputRegion;
 typedef struct AutoScrollInfo AutoScrollInfo;
 
+typedef struct
+{
+    double x1, y1, x2, y2;
+} Box;
+
 struct InputPath
 {
     gboolean			is_stroke;
     cairo_fill_rule_t		fill_rule;
     double			line_width;
     cairo_path_t	       *path;		/* In canvas coordinates */
+    Box				extents;	/* In canvas coordinates */
 
     FooScrollAreaEventFunc	func;
     gpointer			data;
@@ -45,6 +51,12 @@ struct InputPath
     InputPath		       *next;
 };
 
+/* Every partial repaint leaves the strips of older regions it didn't cover
+ * behind, each with copies of all its paths; past this many regions the next
+ * repaint is a full one, which replaces them all with a single region
+ */
+#define MAX_INPUT_REGIONS 8
+
 /* InputRegions are mutually disjoint */
 struct InputRegion
 {
@@ -95,6 +107,8 @@ struct FooScrollAreaPrivate
 
     cairo_surface_t	       *surface;
     cairo_region_t		       *update_region;		/* In canvas coordinates */
+
+    cairo_t		       *hit_cr;		/* for testing points against input paths */
 };
 
 enum
@@ -139,6 +153,9 @@ static gboolean foo_scroll_area_button_release (CtkWidget *widget,
 						CdkEventButton *event);
 static gboolean foo_scroll_area_motion (CtkWidget *widget,
 					CdkEventMotion *event);
+static void foo_scroll_area_style_updated (CtkWidget *widget);
+static void foo_scroll_area_state_flags_changed (CtkWidget *widget,
+						 CtkStateFlags previous_state);
 
 static void
 foo_scroll_area_map (CtkWidget *widget)
@@ -172,6 +189,9 @@ foo_scroll_area_finalize (GObject *object)
 
     g_ptr_array_free (scroll_area->priv->input_regions, TRUE);
 
+    if (scroll_area->priv->hit_cr)
+	cairo_destroy (scroll_area->priv->hit_cr);
+
     g_free (scroll_area->priv);
 
     G_OBJECT_CLASS (foo_scroll_area_parent_class)->finalize (object);
@@ -249,6 +269,8 @@ foo_scroll_area_class_init (FooScrollAreaClass *class)
     widget_class->motion_notify_event = foo_scroll_area_motion;
     widget_class->map = foo_scroll_area_map;
     widget_class->unmap = foo_scroll_area_unmap;
+    widget_class->style_updated = foo_scroll_area_style_updated;
+    widget_class->state_flags_changed = foo_scroll_area_state_flags_changed;
 
     ctk_widget_class_set_css_name (widget_class, "foo-scroll-area");
 
@@ -291,6 +313,11 @@ new_adjustment (void)
     return CTK_ADJUSTMENT (ctk_adjustment_new (0.0, 0.0, 0.0, 0.0, 0.0, 0.0));
 }
 
+static void
+on_scale_factor_changed (GObject    *object,
+			 GParamSpec *pspec,
+			 gpointer    data);
+
 static void
 foo_scroll_area_init (FooScrollArea *scroll_area)
 {
@@ -314,6 +341,9 @@ foo_scroll_area_init (FooScrollArea *scroll_area)
     scroll_area->priv->input_regions = g_ptr_array_new ();
     scroll_area->priv->surface = NULL;
     scroll_area->priv->update_region = cairo_region_create ();
+
+    g_signal_connect (widget, "notify::scale-factor",
+		      G_CALLBACK (on_scale_factor_changed), NULL);
 }
 
 typedef void (* PathForeachFunc) (double  *x,
@@ -350,11 +380,6 @@ path_foreach_point (cairo_path_t     *path,
     }
 }
 
-typedef struct
-{
-    double x1, y1, x2, y2;
-} Box;
-
 static void
 input_path_free_list (InputPath *paths)
 {
@@ -473,6 +498,20 @@ foo_scroll_area_draw (CtkWidget *widget,
     cairo_region_t *region;
     CtkAllocation widget_allocation;
 
+    /* Only the invalidated part of the backing surface gets repainted below, so
+     * a redraw that didn't go through foo_scroll_area_invalidate*() repaints
+     * all of it rather than showing whatever the surface held. So does one
+     * that finds the input regions split up too much.
+     */
+    if (cairo_region_is_empty (scroll_area->priv->update_region) ||
+	scroll_area->priv->input_regions->len >= MAX_INPUT_REGIONS)
+    {
+	CdkRectangle viewport;
+
+	get_viewport (scroll_area, &viewport);
+	cairo_region_union_rectangle (scroll_area->priv->update_region, &viewport);
+    }
+
     /* Setup input areas */
     clear_exposed_input_region (scroll_area, scroll_area->priv->update_region);
 
@@ -485,8 +524,14 @@ foo_scroll_area_draw (CtkWidget *widget,
     region = scroll_area->priv->update_region;
     scroll_area->priv->update_region = cairo_region_create ();
 
-    /* Create cairo context */
+    /* Create cairo context. Only the invalidated part of the backing
+     * surface is repainted; the rest of it is still up to date.
+     */
     cr = cairo_create (scroll_area->priv->surface);
+    cairo_translate (cr, -scroll_area->priv->x_offset, -scroll_area->priv->y_offset);
+    cdk_cairo_region (cr, region);
+    cairo_clip (cr);
+    cairo_translate (cr, scroll_area->priv->x_offset, scroll_area->priv->y_offset);
     initialize_background (widget, cr);
 
     g_signal_emit (widget, signals[PAINT], 0, cr);
@@ -638,6 +683,9 @@ foo_scroll_area_realize (CtkWidget *widget)
 							widget_allocation.width, widget_allocation.height);
     cairo_destroy (cr);
 
+    /* The new backing surface has undefined contents */
+    foo_scroll_area_invalidate (area);
+
     cdk_window_set_user_data (area->priv->input_window, area);
 
     ctk_widget_style_attach (widget);
@@ -758,6 +806,48 @@ foo_scroll_area_size_allocate (CtkWidget     *widget,
     emit_viewport_changed (scroll_area, &new_viewport, &old_viewport);
 }
 
+/* The paint handlers may depend on the style, state and scale, none of
+ * which is known to the update region
+ */
+static void
+foo_scroll_area_style_updated (CtkWidget *widget)
+{
+    CTK_WIDGET_CLASS (parent_class)->style_updated (widget);
+
+    foo_scroll_area_invalidate (FOO_SCROLL_AREA (widget));
+}
+
+static void
+foo_scroll_area_state_flags_changed (CtkWidget     *widget,
+				     CtkStateFlags  previous_state)
+{
+    if (CTK_WIDGET_CLASS (parent_class)->state_flags_changed)
+	CTK_WIDGET_CLASS (parent_class)->state_flags_changed (widget, previous_state);
+
+    foo_scroll_area_invalidate (FOO_SCROLL_AREA (widget));
+}
+
+static void
+on_scale_factor_changed (GObject    *object,
+			 GParamSpec *pspec,
+			 gpointer    data)
+{
+    FooScrollArea *scroll_area = FOO_SCROLL_AREA (object);
+    CtkWidget *widget = CTK_WIDGET (object);
+
+    /* The backing surface has the device scale of the old factor */
+    if (ctk_widget_get_realized (widget))
+    {
+	cairo_surface_t *new_surface;
+
+	new_surface = create_new_surface (widget, scroll_area->priv->surface);
+	cairo_surface_destroy (scroll_area->priv->surface);
+	scroll_area->priv->surface = new_surface;
+    }
+
+    foo_scroll_area_invalidate (scroll_area);
+}
+
 static void
 emit_input (FooScrollArea *scroll_area,
 	    FooScrollAreaEventType type,
@@ -781,13 +871,51 @@ emit_input (FooScrollArea *scroll_area,
     func (scroll_area, &event, data);
 }
 
+static gboolean
+input_path_contains_point (FooScrollArea *scroll_area,
+			   InputPath     *path,
+			   int            x,
+			   int            y)
+{
+    cairo_t *cr;
+
+    /* Cheap rejection of the paths that are nowhere near the point */
+    if (x < path->extents.x1 || x > path->extents.x2 ||
+	y < path->extents.y1 || y > path->extents.y2)
+	return FALSE;
+
+    /* The paths are in canvas coordinates already, so any context with an
+     * identity matrix will do for the exact test. Keep one around rather than
+     * creating one for every path on every event.
+     */
+    if (!scroll_area->priv->hit_cr)
+    {
+	cairo_surface_t *surface;
+
+	surface = cairo_image_surface_create (CAIRO_FORMAT_A8, 1, 1);
+	scroll_area->priv->hit_cr = cairo_create (surface);
+	cairo_surface_destroy (surface);
+    }
+
+    cr = scroll_area->priv->hit_cr;
+
+    cairo_new_path (cr);
+    cairo_set_fill_rule (cr, path->fill_rule);
+    cairo_set_line_width (cr, path->line_width);
+    cairo_append_path (cr, path->path);
+
+    if (path->is_stroke)
+	return cairo_in_stroke (cr, x, y);
+    else
+	return cairo_in_fill (cr, x, y);
+}
+
 static void
 process_event (FooScrollArea	       *scroll_area,
 	       FooScrollAreaEventType	input_type,
 	       int			x,
 	       int			y)
 {
-    CtkWidget *widget = CTK_WIDGET (scroll_area);
     int i;
 
     allocation_to_canvas (scroll_area, &x, &y);
@@ -811,22 +939,7 @@ process_event (FooScrollArea	       *scroll_area,
 	    path = region->paths;
 	    while (path)
 	    {
-		cairo_t *cr;
-		gboolean inside;
-
-		cr = cdk_cairo_create (ctk_widget_get_window (widget));
-		cairo_set_fill_rule (cr, path->fill_rule);
-		cairo_set_line_width (cr, path->line_width);
-		cairo_append_path (cr, path->path);
-
-		if (path->is_stroke)
-		    inside = cairo_in_stroke (cr, x, y);
-		else
-		    inside = cairo_in_fill (cr, x, y);
-
-		cairo_destroy (cr);
-
-		if (inside)
+		if (input_path_contains_point (scroll_area, path, x, y))
 		{
 		    emit_input (scroll_area, input_type,
 				x, y,
@@ -887,6 +1000,10 @@ foo_scroll_area_button_release (CtkWidget *widget,
 
     process_cdk_event (area, event->x, event->y, (CdkEvent *)event);
 
+    /* A drag is over; gather the input regions it split up back into one */
+    if (area->priv->input_regions->len > 1)
+	foo_scroll_area_invalidate (area);
+
     return FALSE;
 }
 
@@ -1155,6 +1272,39 @@ user_to_device (double *x, double *y,
     cairo_user_to_device (cr, x, y);
 }
 
+static void
+get_device_extents (cairo_t *cr,
+		    gboolean is_stroke,
+		    Box *box)
+{
+    double x[4], y[4];
+    int i;
+
+    /* The extents include the line joins and caps of strokes */
+    if (is_stroke)
+	cairo_stroke_extents (cr, &x[0], &y[0], &x[2], &y[2]);
+    else
+	cairo_fill_extents (cr, &x[0], &y[0], &x[2], &y[2]);
+
+    x[1] = x[2];
+    y[1] = y[0];
+    x[3] = x[0];
+    y[3] = y[2];
+
+    box->x1 = box->y1 = G_MAXDOUBLE;
+    box->x2 = box->y2 = -G_MAXDOUBLE;
+
+    for (i = 0; i < 4; ++i)
+    {
+	cairo_user_to_device (cr, &x[i], &y[i]);
+
+	box->x1 = MIN (box->x1, x[i]);
+	box->y1 = MIN (box->y1, y[i]);
+	box->x2 = MAX (box->x2, x[i]);
+	box->y2 = MAX (box->y2, y[i]);
+    }
+}
+
 static InputPath *
 make_path (FooScrollArea *area,
 	   cairo_t *cr,
@@ -1167,6 +1317,7 @@ make_path (FooScrollArea *area,
     path->is_stroke = is_stroke;
     path->fill_rule = cairo_get_fill_rule (cr);
     path->line_width = cairo_get_line_width (cr);
+    get_device_extents (cr, is_stroke, &path->extents);
     path->path = cairo_copy_path (cr);
     path_foreach_point (path->path, user_to_device, cr);
     path->func = func;
@@ -22,6 +22,7 @@
 #include <config.h>
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <sys/wait.h>
 
 #include <ctk/ctk.h>
@@ -34,10 +35,16 @@
 #include <cdk/cdkx.h>
 #include <X11/Xlib.h>
 #include <glib/gi18n.h>
+#include <glib/gstdio.h>
 #include <gio/gio.h>
 
 #include "capplet-util.h"
 
+/* RandR notifications arriving within this many milliseconds of each other
+ * are handled together
+ */
+#define SCREEN_CHANGED_TIMEOUT 100
+
 typedef struct App App;
 typedef struct GrabInfo GrabInfo;
 
@@ -47,6 +54,7 @@ struct App
     CafeRRConfig  *current_configuration;
     CafeRRLabeler *labeler;
     CafeRROutputInfo         *current_output;
+    guint          screen_changed_id;
 
     CtkWidget	   *dialog;
     CtkWidget      *current_monitor_event_box;
@@ -60,6 +68,7 @@ struct App
     CtkWidget	   *clone_checkbox;
     CtkWidget	   *show_icon_checkbox;
     CtkWidget      *primary_button;
+    CtkWidget      *options_grid;
 
     /* We store the event timestamp when the Apply button is clicked */
     CtkWidget      *apply_button;
@@ -67,11 +76,37 @@ struct App
 
     CtkWidget      *area;
     gboolean	    ignore_gui_changes;
+
+    /* The connected outputs of current_configuration in order, and the layouts of
+     * their names for the canvas; both are rebuilt when the configuration is replaced
+     */
+    GPtrArray      *connected_outputs;
+    GPtrArray      *name_layouts;
+    gboolean        name_layouts_clone;
+
+    /* Pre-rendered canvas pieces, see get_background() and get_output_decoration() */
+    GPtrArray      *output_decorations;
+    cairo_surface_t *background;
+    int             background_width, background_height;
+    CdkRGBA         background_color, background_border_color;
+
+    /* Models for the resolution and rate combos, keyed by output (and size, for the
+     * rates); they only depend on the modes of the screen, so they are built once
+     * per screen refresh and swapped in when another output is selected
+     */
+    GHashTable     *resolution_stores;
+    GHashTable     *rate_stores;
     GSettings	   *settings;
 
-    /* These are used while we are waiting for the ApplyConfiguration method to be executed over D-bus */
+    /* These are used while we are saving the configuration and waiting for the
+     * ApplyConfiguration method to be executed over D-bus; closing the dialog
+     * cancels whatever step is still pending
+     */
+    GCancellable *apply_cancellable;
     GDBusConnection *connection;
     GDBusProxy *proxy;
+    gboolean apply_saving;	/* the save thread is still running */
+    gboolean apply_unsent;	/* monitors.xml holds a configuration the daemon wasn't asked to apply */
 
     enum {
 	APPLYING_VERSION_1,
@@ -94,6 +129,7 @@ static void get_geometry (CafeRROutputInfo *output, int *w, int *h);
 static void apply_configuration_returned_cb (GObject *source_object, GAsyncResult *res, gpointer data);
 static gboolean get_clone_size (CafeRRScreen *screen, int *width, int *height);
 static gboolean output_info_supports_mode (App *app, CafeRROutputInfo *info, int width, int height);
+static void invalidate_connected_outputs (App *app);
 
 static void
 error_message (App *app, const char *primary_text, const char *secondary_text)
@@ -128,15 +164,59 @@ idle_free (gchar *s)
     return s;
 }
 
+static CafeRROutputInfo *
+find_output_by_name (CafeRRConfig *config, const char *name)
+{
+    CafeRROutputInfo **outputs = cafe_rr_config_get_outputs (config);
+    int i;
+
+    for (i = 0; outputs[i] != NULL; ++i)
+    {
+	if (strcmp (cafe_rr_output_info_get_name (outputs[i]), name) == 0)
+	    return outputs[i];
+    }
+
+    return NULL;
+}
+
 static void
-on_screen_changed (CafeRRScreen *scr,
-		   gpointer data)
+update_from_screen (App *app)
 {
     CafeRRConfig *current;
-    App *app = data;
+    CafeRROutputInfo *selected;
 
     current = cafe_rr_config_new_current (app->screen, NULL);
 
+    /* The modes may have changed even if the configuration didn't; the
+     * stores are only rebuilt for the outputs that get selected again
+     */
+    g_hash_table_remove_all (app->resolution_stores);
+    g_hash_table_remove_all (app->rate_stores);
+
+    /* Many notifications don't change the configuration, e.g. the ones
+     * for the configuration we just applied ourselves; keep the selection
+     * and only refill the widgets, whose mode stores were just dropped
+     */
+    if (app->current_configuration &&
+	cafe_rr_config_equal (current, app->current_configuration))
+    {
+	g_object_unref (current);
+	rebuild_gui (app);
+	return;
+    }
+
+    /* Keep the selected output if it is still there */
+    selected = NULL;
+    if (app->current_output)
+    {
+	selected = find_output_by_name (current, cafe_rr_output_info_get_name (app->current_output));
+
+	if (selected && !cafe_rr_output_info_is_connected (selected))
+	    selected = NULL;
+    }
+
+    invalidate_connected_outputs (app);
+
     if (app->current_configuration)
 	g_object_unref (app->current_configuration);
 
@@ -150,7 +230,41 @@ on_screen_changed (CafeRRScreen *scr,
 
     app->labeler = cafe_rr_labeler_new (app->current_configuration);
 
-    select_current_output_from_dialog_position (app);
+    if (selected)
+    {
+	app->current_output = selected;
+	rebuild_gui (app);
+    }
+    else
+    {
+	select_current_output_from_dialog_position (app);
+    }
+
+    foo_scroll_area_invalidate (FOO_SCROLL_AREA (app->area));
+}
+
+static gboolean
+screen_changed_timeout_cb (gpointer data)
+{
+    App *app = data;
+
+    app->screen_changed_id = 0;
+
+    update_from_screen (app);
+
+    return FALSE;
+}
+
+static void
+on_screen_changed (CafeRRScreen *scr,
+		   gpointer data)
+{
+    App *app = data;
+
+    /* Hotplugging a dock produces a burst of these; only refresh once */
+    if (app->screen_changed_id == 0)
+	app->screen_changed_id = g_timeout_add (SCREEN_CHANGED_TIMEOUT,
+						screen_changed_timeout_cb, app);
 }
 
 static void
@@ -179,63 +293,76 @@ layout_set_font (PangoLayout *layout, const char *font)
     }
 }
 
-static void
-clear_combo (CtkWidget *widget)
+/* Every combo store keeps an index of its rows by their text, so that
+ * adding and selecting a key doesn't have to walk the whole model
+ */
+static GHashTable *
+get_store_keys (CtkTreeModel *model)
 {
-    CtkComboBox *box = CTK_COMBO_BOX (widget);
-    CtkTreeModel *model = ctk_combo_box_get_model (box);
-    CtkListStore *store = CTK_LIST_STORE (model);
-
-    ctk_list_store_clear (store);
+    return g_object_get_data (G_OBJECT (model), "keys");
 }
 
-typedef struct
-{
-    const char *text;
-    gboolean found;
-    CtkTreeIter iter;
-} ForeachInfo;
-
-static gboolean
-foreach (CtkTreeModel *model,
-	 CtkTreePath *path,
-	 CtkTreeIter *iter,
-	 gpointer data)
+static CtkListStore *
+new_combo_store (int sort_column)
 {
-    ForeachInfo *info = data;
-    char *text = NULL;
-
-    ctk_tree_model_get (model, iter, 0, &text, -1);
+    CtkListStore *store = ctk_list_store_new (
+	6,
+	G_TYPE_STRING,		/* Text */
+	G_TYPE_INT,		/* Width */
+	G_TYPE_INT,		/* Height */
+	G_TYPE_INT,		/* Frequency */
+	G_TYPE_INT,		/* Width * Height */
+	G_TYPE_INT);		/* Rotation */
 
-    g_assert (text != NULL);
+    g_object_set_data_full (G_OBJECT (store), "keys",
+			    g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify) ctk_tree_iter_free),
+			    (GDestroyNotify) g_hash_table_destroy);
 
-    if (strcmp (info->text, text) == 0)
+    if (sort_column != -1)
     {
-	info->found = TRUE;
-	info->iter = *iter;
-	return TRUE;
+	ctk_tree_sortable_set_sort_column_id (CTK_TREE_SORTABLE (store),
+					      sort_column,
+					      CTK_SORT_DESCENDING);
     }
 
-    return FALSE;
+    return store;
 }
 
+/* Stores from the caches are shared between outputs, so they are swapped
+ * in and out of the combos and never cleared; a NULL store empties the combo
+ */
 static void
-add_key (CtkWidget *widget,
-	 const char *text,
-	 int width, int height, int rate,
-	 CafeRRRotation rotation)
+set_combo_store (CtkWidget *widget, CtkListStore *store)
+{
+    CtkComboBox *box = CTK_COMBO_BOX (widget);
+
+    if (ctk_combo_box_get_model (box) != (CtkTreeModel *) store)
+	ctk_combo_box_set_model (box, (CtkTreeModel *) store);
+    else
+	ctk_combo_box_set_active (box, -1);
+}
+
+/* Only for combos whose store is not shared, see set_combo_store() */
+static void
+clear_combo (CtkWidget *widget)
 {
-    ForeachInfo info;
     CtkComboBox *box = CTK_COMBO_BOX (widget);
     CtkTreeModel *model = ctk_combo_box_get_model (box);
     CtkListStore *store = CTK_LIST_STORE (model);
 
-    info.text = text;
-    info.found = FALSE;
+    ctk_list_store_clear (store);
+    g_hash_table_remove_all (get_store_keys (model));
+}
 
-    ctk_tree_model_foreach (model, foreach, &info);
+static void
+add_key (CtkListStore *store,
+	 const char *text,
+	 int width, int height, int rate,
+	 CafeRRRotation rotation)
+{
+    GHashTable *keys = get_store_keys (CTK_TREE_MODEL (store));
 
-    if (!info.found)
+    if (!g_hash_table_contains (keys, text))
     {
 	CtkTreeIter iter;
 	ctk_list_store_insert_with_values (store, &iter, -1,
@@ -247,6 +374,8 @@ add_key (CtkWidget *widget,
                                            5, rotation,
                                            -1);
 
+	/* list store iters stay valid when the store is sorted */
+	g_hash_table_insert (keys, g_strdup (text), ctk_tree_iter_copy (&iter));
     }
 }
 
@@ -255,17 +384,14 @@ combo_select (CtkWidget *widget, const char *text)
 {
     CtkComboBox *box = CTK_COMBO_BOX (widget);
     CtkTreeModel *model = ctk_combo_box_get_model (box);
-    ForeachInfo info;
-
-    info.text = text;
-    info.found = FALSE;
+    CtkTreeIter *iter;
 
-    ctk_tree_model_foreach (model, foreach, &info);
+    iter = g_hash_table_lookup (get_store_keys (model), text);
 
-    if (!info.found)
+    if (!iter)
 	return FALSE;
 
-    ctk_combo_box_set_active_iter (box, &info.iter);
+    ctk_combo_box_set_active_iter (box, iter);
     return TRUE;
 }
 
@@ -331,7 +457,8 @@ rebuild_rotation_combo (App *app)
 	/* NULL-GError --- FIXME: we should say why this rotation is not available! */
 	if (cafe_rr_config_applicable (app->current_configuration, app->screen, NULL))
 	{
- 	    add_key (app->rotation_combo, _(info->name), 0, 0, 0, info->rotation);
+ 	    add_key (CTK_LIST_STORE (ctk_combo_box_get_model (CTK_COMBO_BOX (app->rotation_combo))),
+		     _(info->name), 0, 0, 0, info->rotation);
 
 	    if (info->rotation == current)
 		selection = _(info->name);
@@ -350,30 +477,40 @@ make_rate_string (int hz)
     return g_strdup_printf (_("%d Hz"), hz);
 }
 
-static void
-rebuild_rate_combo (App *app)
+/* The key of the current output in the combo store caches; in clone mode all
+ * the outputs share the clone modes
+ */
+static const char *
+get_current_modes_key (App *app)
 {
-    CafeRRMode **modes;
-    int best;
+    if (cafe_rr_config_get_clone (app->current_configuration))
+	return "";
+
+    return cafe_rr_output_info_get_name (app->current_output);
+}
+
+static CtkListStore *
+get_rate_store (App *app, CafeRRMode **modes, int output_width, int output_height)
+{
+    CtkListStore *store;
+    char *key;
     int i;
 
-    clear_combo (app->refresh_combo);
+    key = g_strdup_printf ("%s\n%dx%d", get_current_modes_key (app), output_width, output_height);
 
-    ctk_widget_set_sensitive (
-	app->refresh_combo, app->current_output && cafe_rr_output_info_is_active (app->current_output));
+    store = g_hash_table_lookup (app->rate_stores, key);
+    if (store)
+    {
+	g_free (key);
+	return store;
+    }
 
-    if (!app->current_output
-        || !(modes = get_current_modes (app)))
-	return;
+    store = new_combo_store (3);
 
-    best = -1;
     for (i = 0; modes[i] != NULL; ++i)
     {
 	CafeRRMode *mode = modes[i];
 	int width, height, rate;
-	int output_width, output_height;
-
-	cafe_rr_output_info_get_geometry (app->current_output, NULL, NULL, &output_width, &output_height);
 
 	width = cafe_rr_mode_get_width (mode);
 	height = cafe_rr_mode_get_height (mode);
@@ -382,17 +519,40 @@ rebuild_rate_combo (App *app)
 	if (width == output_width		&&
 	    height == output_height)
 	{
-	    add_key (app->refresh_combo,
+	    add_key (store,
 		     idle_free (make_rate_string (rate)),
 		     0, 0, rate, -1);
-
-	    if (rate > best)
-		best = rate;
 	}
     }
 
+    g_hash_table_insert (app->rate_stores, key, store);
+
+    return store;
+}
+
+static void
+rebuild_rate_combo (App *app)
+{
+    CafeRRMode **modes;
+    int output_width, output_height;
+
+    ctk_widget_set_sensitive (
+	app->refresh_combo, app->current_output && cafe_rr_output_info_is_active (app->current_output));
+
+    if (!app->current_output
+        || !(modes = get_current_modes (app)))
+    {
+	set_combo_store (app->refresh_combo, NULL);
+	return;
+    }
+
+    cafe_rr_output_info_get_geometry (app->current_output, NULL, NULL, &output_width, &output_height);
+
+    set_combo_store (app->refresh_combo, get_rate_store (app, modes, output_width, output_height));
+
+    /* the store is sorted by descending rate, so the first row is the best one */
     if (!combo_select (app->refresh_combo, idle_free (make_rate_string (cafe_rr_output_info_get_refresh_rate (app->current_output)))))
-	combo_select (app->refresh_combo, idle_free (make_rate_string (best)));
+	ctk_combo_box_set_active (CTK_COMBO_BOX (app->refresh_combo), 0);
 }
 
 static int
@@ -578,20 +738,50 @@ find_best_mode (CafeRRMode **modes, int *out_width, int *out_height)
     }
 }
 
+static CtkListStore *
+get_resolution_store (App *app, CafeRRMode **modes)
+{
+    CtkListStore *store;
+    const char *key;
+    int i;
+
+    key = get_current_modes_key (app);
+
+    store = g_hash_table_lookup (app->resolution_stores, key);
+    if (store)
+	return store;
+
+    store = new_combo_store (4);
+
+    for (i = 0; modes[i] != NULL; ++i)
+    {
+	int width, height;
+
+	width = cafe_rr_mode_get_width (modes[i]);
+	height = cafe_rr_mode_get_height (modes[i]);
+
+	add_key (store,
+		 idle_free (make_resolution_string (width, height)),
+		 width, height, 0, -1);
+    }
+
+    g_hash_table_insert (app->resolution_stores, g_strdup (key), store);
+
+    return store;
+}
+
 static void
 rebuild_resolution_combo (App *app)
 {
-    int i;
     CafeRRMode **modes;
     const char *current;
     int output_width, output_height;
 
-    clear_combo (app->resolution_combo);
-
     if (!(modes = get_current_modes (app))
 	|| !app->current_output
 	|| !cafe_rr_output_info_is_active (app->current_output))
     {
+	set_combo_store (app->resolution_combo, NULL);
 	ctk_widget_set_sensitive (app->resolution_combo, FALSE);
 	return;
     }
@@ -603,17 +793,7 @@ rebuild_resolution_combo (App *app)
 
     ctk_widget_set_sensitive (app->resolution_combo, TRUE);
 
-    for (i = 0; modes[i] != NULL; ++i)
-    {
-	int width, height;
-
-	width = cafe_rr_mode_get_width (modes[i]);
-	height = cafe_rr_mode_get_height (modes[i]);
-
-	add_key (app->resolution_combo,
-		 idle_free (make_resolution_string (width, height)),
-		 width, height, 0, -1);
-    }
+    set_combo_store (app->resolution_combo, get_resolution_store (app, modes));
 
     current = idle_free (make_resolution_string (output_width, output_height));
 
@@ -1049,67 +1229,86 @@ get_geometry (CafeRROutputInfo *output, int *w, int *h)
 #define SPACE 15
 #define MARGIN  15
 
-static GList *
-list_connected_outputs (App *app, int *total_w, int *total_h)
+static void
+invalidate_connected_outputs (App *app)
+{
+    if (app->connected_outputs)
+    {
+	g_ptr_array_free (app->connected_outputs, TRUE);
+	app->connected_outputs = NULL;
+    }
+
+    if (app->name_layouts)
+    {
+	g_ptr_array_free (app->name_layouts, TRUE);
+	app->name_layouts = NULL;
+    }
+
+    if (app->output_decorations)
+    {
+	g_ptr_array_free (app->output_decorations, TRUE);
+	app->output_decorations = NULL;
+    }
+}
+
+static GPtrArray *
+get_connected_outputs (App *app)
 {
-    int i, dummy;
-    GList *result = NULL;
+    int i;
     CafeRROutputInfo **outputs;
 
-    if (!total_w)
-	total_w = &dummy;
-    if (!total_h)
-	total_h = &dummy;
+    if (app->connected_outputs)
+	return app->connected_outputs;
 
-    *total_w = 0;
-    *total_h = 0;
+    app->connected_outputs = g_ptr_array_new ();
 
-    outputs = cafe_rr_config_get_outputs(app->current_configuration);
+    outputs = cafe_rr_config_get_outputs (app->current_configuration);
     for (i = 0; outputs[i] != NULL; ++i)
     {
 	if (cafe_rr_output_info_is_connected (outputs[i]))
-	{
-	    int w, h;
-
-	    result = g_list_prepend (result, outputs[i]);
-
-	    get_geometry (outputs[i], &w, &h);
-
-	    *total_w += w;
-	    *total_h += h;
-	}
+	    g_ptr_array_add (app->connected_outputs, outputs[i]);
     }
 
-    return g_list_reverse (result);
+    return app->connected_outputs;
 }
 
 static int
 get_n_connected (App *app)
 {
-    GList *connected_outputs = list_connected_outputs (app, NULL, NULL);
-    int n = g_list_length (connected_outputs);
+    return get_connected_outputs (app)->len;
+}
+
+static void
+get_total_size (App *app, int *total_w, int *total_h)
+{
+    GPtrArray *connected_outputs = get_connected_outputs (app);
+    guint i;
+
+    *total_w = 0;
+    *total_h = 0;
 
-    g_list_free (connected_outputs);
+    /* the sizes are not part of the snapshot, they change with the mode and rotation */
+    for (i = 0; i < connected_outputs->len; ++i)
+    {
+	int w, h;
 
-    return n;
+	get_geometry (g_ptr_array_index (connected_outputs, i), &w, &h);
+
+	*total_w += w;
+	*total_h += h;
+    }
 }
 
 static double
-compute_scale (App *app)
+compute_scale_for_size (App *app, int total_w, int total_h)
 {
     int available_w, available_h;
-    int total_w, total_h;
     int n_monitors;
     CdkRectangle viewport;
-    GList *connected_outputs;
 
     foo_scroll_area_get_viewport (FOO_SCROLL_AREA (app->area), &viewport);
 
-    connected_outputs = list_connected_outputs (app, &total_w, &total_h);
-
-    n_monitors = g_list_length (connected_outputs);
-
-    g_list_free (connected_outputs);
+    n_monitors = get_n_connected (app);
 
     available_w = viewport.width - 2 * MARGIN - (n_monitors - 1) * SPACE;
     available_h = viewport.height - 2 * MARGIN - (n_monitors - 1) * SPACE;
@@ -1117,6 +1316,46 @@ compute_scale (App *app)
     return MIN ((double)available_w / total_w, (double)available_h / total_h);
 }
 
+static double
+compute_scale (App *app)
+{
+    int total_w, total_h;
+
+    get_total_size (app, &total_w, &total_h);
+
+    return compute_scale_for_size (app, total_w, total_h);
+}
+
+/* The area of the canvas that paint_output() draws @output into, rounded
+ * outwards so that it can be used for invalidating.
+ */
+static void
+get_output_canvas_rect (App *app, CafeRROutputInfo *output, CdkRectangle *rect)
+{
+    int total_w, total_h;
+    int output_x, output_y;
+    int w, h;
+    double scale;
+    double x, y;
+    CdkRectangle viewport;
+
+    get_total_size (app, &total_w, &total_h);
+    scale = compute_scale_for_size (app, total_w, total_h);
+
+    foo_scroll_area_get_viewport (FOO_SCROLL_AREA (app->area), &viewport);
+
+    get_geometry (output, &w, &h);
+    cafe_rr_output_info_get_geometry (output, &output_x, &output_y, NULL, NULL);
+
+    x = output_x * scale + MARGIN + (viewport.width - 2 * MARGIN - total_w * scale) / 2.0;
+    y = output_y * scale + MARGIN + (viewport.height - 2 * MARGIN - total_h * scale) / 2.0;
+
+    rect->x = viewport.x + (int) x - 1;
+    rect->y = viewport.y + (int) y - 1;
+    rect->width = (int) (w * scale + 0.5) + 4;
+    rect->height = (int) (h * scale + 0.5) + 4;
+}
+
 typedef struct Edge
 {
     CafeRROutputInfo *output;
@@ -1160,19 +1399,6 @@ list_edges_for_output (CafeRROutputInfo *output, GArray *edges)
     add_edge (output, x + w, y, x + w, y + h, edges);
 }
 
-static void
-list_edges (CafeRRConfig *config, GArray *edges)
-{
-    int i;
-    CafeRROutputInfo **outputs = cafe_rr_config_get_outputs (config);
-
-    for (i = 0; outputs[i]; ++i)
-    {
-	if (cafe_rr_output_info_is_connected (outputs[i]))
-	    list_edges_for_output (outputs[i], edges);
-    }
-}
-
 static gboolean
 overlap (int s1, int e1, int s2, int e2)
 {
@@ -1254,26 +1480,16 @@ add_edge_snaps (Edge *snapper, Edge *snappee, GArray *snaps)
 }
 
 static void
-list_snaps (CafeRROutputInfo *output, GArray *edges, GArray *snaps)
+list_snaps (GArray *output_edges, GArray *other_edges, GArray *snaps)
 {
-    int i;
+    int i, j;
 
-    for (i = 0; i < edges->len; ++i)
+    for (i = 0; i < output_edges->len; ++i)
     {
-	Edge *output_edge = &(g_array_index (edges, Edge, i));
+	Edge *output_edge = &(g_array_index (output_edges, Edge, i));
 
-	if (output_edge->output == output)
-	{
-	    int j;
-
-	    for (j = 0; j < edges->len; ++j)
-	    {
-		Edge *edge = &(g_array_index (edges, Edge, j));
-
-		if (edge->output != output)
-		    add_edge_snaps (output_edge, edge, snaps);
-	    }
-	}
+	for (j = 0; j < other_edges->len; ++j)
+	    add_edge_snaps (output_edge, &(g_array_index (other_edges, Edge, j)), snaps);
     }
 }
 
@@ -1309,41 +1525,25 @@ edges_align (Edge *e1, Edge *e2)
     return FALSE;
 }
 
+/* Takes the four edges of two outputs, as listed by list_edges_for_output() */
 static gboolean
-output_is_aligned (CafeRROutputInfo *output, GArray *edges)
+outputs_align (Edge *edges1, Edge *edges2)
 {
-    gboolean result = FALSE;
-    int i;
+    int i, j;
 
-    for (i = 0; i < edges->len; ++i)
+    /* We are aligned if an output edge matches
+     * an edge of another output
+     */
+    for (i = 0; i < 4; ++i)
     {
-	Edge *output_edge = &(g_array_index (edges, Edge, i));
-
-	if (output_edge->output == output)
+	for (j = 0; j < 4; ++j)
 	{
-	    int j;
-
-	    for (j = 0; j < edges->len; ++j)
-	    {
-		Edge *edge = &(g_array_index (edges, Edge, j));
-
-		/* We are aligned if an output edge matches
-		 * an edge of another output
-		 */
-		if (edge->output != output_edge->output)
-		{
-		    if (edges_align (output_edge, edge))
-		    {
-			result = TRUE;
-			goto done;
-		    }
-		}
-	    }
+	    if (edges_align (&edges1[i], &edges2[j]))
+		return TRUE;
 	}
     }
-done:
 
-    return result;
+    return FALSE;
 }
 
 static void
@@ -1378,36 +1578,126 @@ output_overlaps (CafeRROutputInfo *output, CafeRRConfig *config)
     return FALSE;
 }
 
-static gboolean
-cafe_rr_config_is_aligned (CafeRRConfig *config, GArray *edges)
+typedef struct StaticOutput
 {
-    int i;
-    gboolean result = TRUE;
-    CafeRROutputInfo **outputs;
+    CdkRectangle rect;
+    gboolean aligned;		/* with another output that is not being dragged */
+} StaticOutput;
+
+struct GrabInfo
+{
+    int grab_x;
+    int grab_y;
+    int output_x;
+    int output_y;
+
+    /* Only the grabbed output moves during a drag, so what the snapping needs to
+     * know about the other ones is worked out once when the grab starts.  The
+     * edges of static output i are static_edges[4 * i] to static_edges[4 * i + 3].
+     */
+    GArray *static_outputs;
+    GArray *static_edges;
+    gboolean static_overlap;
+
+    GArray *output_edges;
+    GArray *candidate_edges;
+};
+
+static GrabInfo *
+grab_info_new (CafeRRConfig *config, CafeRROutputInfo *grabbed)
+{
+    GrabInfo *info = g_new0 (GrabInfo, 1);
+    CafeRROutputInfo **outputs = cafe_rr_config_get_outputs (config);
+    int i, j;
+
+    info->static_outputs = g_array_new (FALSE, FALSE, sizeof (StaticOutput));
+    info->static_edges = g_array_new (FALSE, FALSE, sizeof (Edge));
+    info->output_edges = g_array_new (FALSE, FALSE, sizeof (Edge));
+    info->candidate_edges = g_array_new (FALSE, FALSE, sizeof (Edge));
 
-    outputs = cafe_rr_config_get_outputs(config);
     for (i = 0; outputs[i]; ++i)
     {
-	if (cafe_rr_output_info_is_connected (outputs[i]))
+	StaticOutput static_output;
+
+	if (outputs[i] == grabbed || !cafe_rr_output_info_is_connected (outputs[i]))
+	    continue;
+
+	get_output_rect (outputs[i], &static_output.rect);
+	static_output.aligned = FALSE;
+
+	g_array_append_val (info->static_outputs, static_output);
+	list_edges_for_output (outputs[i], info->static_edges);
+    }
+
+    for (i = 0; i < info->static_outputs->len; ++i)
+    {
+	StaticOutput *output_i = &(g_array_index (info->static_outputs, StaticOutput, i));
+
+	for (j = 0; j < info->static_outputs->len; ++j)
 	{
-	    if (!output_is_aligned (outputs[i], edges))
-		return FALSE;
+	    StaticOutput *output_j = &(g_array_index (info->static_outputs, StaticOutput, j));
+
+	    if (i == j)
+		continue;
+
+	    if (cdk_rectangle_intersect (&output_i->rect, &output_j->rect, NULL))
+		info->static_overlap = TRUE;
 
-	    if (output_overlaps (outputs[i], config))
-		return FALSE;
+	    if (!output_i->aligned &&
+		outputs_align (&(g_array_index (info->static_edges, Edge, 4 * i)),
+			       &(g_array_index (info->static_edges, Edge, 4 * j))))
+		output_i->aligned = TRUE;
 	}
     }
 
-    return result;
+    return info;
 }
 
-struct GrabInfo
+static void
+grab_info_free (GrabInfo *info)
 {
-    int grab_x;
-    int grab_y;
-    int output_x;
-    int output_y;
-};
+    g_array_free (info->static_outputs, TRUE);
+    g_array_free (info->static_edges, TRUE);
+    g_array_free (info->output_edges, TRUE);
+    g_array_free (info->candidate_edges, TRUE);
+    g_free (info);
+}
+
+/* Whether the whole configuration is aligned with the grabbed output where it
+ * currently is: every output shares an edge with another one, and none of them
+ * overlap.
+ */
+static gboolean
+grabbed_output_is_aligned (GrabInfo *info, CafeRROutputInfo *grabbed)
+{
+    CdkRectangle rect;
+    gboolean aligned = FALSE;
+    int i;
+
+    if (info->static_overlap)
+	return FALSE;
+
+    get_output_rect (grabbed, &rect);
+
+    g_array_set_size (info->candidate_edges, 0);
+    list_edges_for_output (grabbed, info->candidate_edges);
+
+    for (i = 0; i < info->static_outputs->len; ++i)
+    {
+	StaticOutput *static_output = &(g_array_index (info->static_outputs, StaticOutput, i));
+
+	if (cdk_rectangle_intersect (&rect, &static_output->rect, NULL))
+	    return FALSE;
+
+	if (outputs_align ((Edge *) info->candidate_edges->data,
+			   &(g_array_index (info->static_edges, Edge, 4 * i))))
+	    aligned = TRUE;
+	else if (!static_output->aligned)
+	    return FALSE;
+    }
+
+    return aligned;
+}
 
 static gboolean
 is_corner_snap (const Snap *s)
@@ -1520,7 +1810,7 @@ on_output_event (FooScrollArea *area,
 
 	    foo_scroll_area_begin_grab (area, on_output_event, data);
 
-	    info = g_new0 (GrabInfo, 1);
+	    info = grab_info_new (app->current_configuration, output);
 	    info->grab_x = event->x;
 	    info->grab_y = event->y;
 	    info->output_x = output_x;
@@ -1541,7 +1831,11 @@ on_output_event (FooScrollArea *area,
 	    int width, height;
 	    int new_x, new_y;
 	    int i;
-	    GArray *edges, *snaps, *new_edges;
+	    GArray *snaps;
+	    CdkRectangle old_rect, new_rect;
+	    cairo_region_t *damage;
+
+	    get_output_canvas_rect (app, output, &old_rect);
 
 	    cafe_rr_output_info_get_geometry (output, &old_x, &old_y, &width, &height);
 	    new_x = info->output_x + (event->x - info->grab_x) / scale;
@@ -1549,48 +1843,34 @@ on_output_event (FooScrollArea *area,
 
 	    cafe_rr_output_info_set_geometry (output, new_x, new_y, width, height);
 
-	    edges = g_array_new (TRUE, TRUE, sizeof (Edge));
 	    snaps = g_array_new (TRUE, TRUE, sizeof (Snap));
-	    new_edges = g_array_new (TRUE, TRUE, sizeof (Edge));
 
-	    list_edges (app->current_configuration, edges);
-	    list_snaps (output, edges, snaps);
+	    g_array_set_size (info->output_edges, 0);
+	    list_edges_for_output (output, info->output_edges);
+	    list_snaps (info->output_edges, info->static_edges, snaps);
 
 	    g_array_sort (snaps, compare_snaps);
 
-	    cafe_rr_output_info_set_geometry (output, new_x, new_y, width, height);
-
 	    for (i = 0; i < snaps->len; ++i)
 	    {
 		Snap *snap = &(g_array_index (snaps, Snap, i));
-		GArray *new_edges = g_array_new (TRUE, TRUE, sizeof (Edge));
 
 		cafe_rr_output_info_set_geometry (output, new_x + snap->dx, new_y + snap->dy, width, height);
 
-		g_array_set_size (new_edges, 0);
-		list_edges (app->current_configuration, new_edges);
-
-		if (cafe_rr_config_is_aligned (app->current_configuration, new_edges))
-		{
-		    g_array_free (new_edges, TRUE);
+		if (grabbed_output_is_aligned (info, output))
 		    break;
-		}
 		else
-		{
 		    cafe_rr_output_info_set_geometry (output, info->output_x, info->output_y, width, height);
-		}
 	    }
 
-	    g_array_free (new_edges, TRUE);
 	    g_array_free (snaps, TRUE);
-	    g_array_free (edges, TRUE);
 
 	    if (event->type == FOO_BUTTON_RELEASE)
 	    {
 		foo_scroll_area_end_grab (area);
 		set_monitors_tooltip (app, FALSE);
 
-		g_free (g_object_get_data (G_OBJECT (output), "grab-info"));
+		grab_info_free (info);
 		g_object_set_data (G_OBJECT (output), "grab-info", NULL);
 
 #if 0
@@ -1598,7 +1878,15 @@ on_output_event (FooScrollArea *area,
 #endif
 	    }
 
-	    foo_scroll_area_invalidate (area);
+	    /* Only the grabbed output moves, so only repaint where it was and
+	     * where it is now; the other outputs stay in the backing surface.
+	     */
+	    get_output_canvas_rect (app, output, &new_rect);
+
+	    damage = cairo_region_create_rectangle (&old_rect);
+	    cairo_region_union_rectangle (damage, &new_rect);
+	    foo_scroll_area_invalidate_region (area, damage);
+	    cairo_region_destroy (damage);
 	}
     }
 }
@@ -1640,21 +1928,50 @@ get_display_name (App *app,
     return layout;
 }
 
-static void
-paint_background (FooScrollArea *area,
-		  cairo_t       *cr)
+/* The name layout of the i-th connected output */
+static PangoLayout *
+get_output_name_layout (App *app, int i)
+{
+    gboolean clone = cafe_rr_config_get_clone (app->current_configuration);
+    PangoLayout *layout;
+
+    /* the text is not the same when mirroring */
+    if (app->name_layouts && app->name_layouts_clone != clone)
+    {
+	g_ptr_array_free (app->name_layouts, TRUE);
+	app->name_layouts = NULL;
+    }
+
+    if (!app->name_layouts)
+    {
+	app->name_layouts = g_ptr_array_new_with_free_func (g_object_unref);
+	g_ptr_array_set_size (app->name_layouts, get_n_connected (app));
+	app->name_layouts_clone = clone;
+    }
+
+    layout = g_ptr_array_index (app->name_layouts, i);
+    if (!layout)
+    {
+	layout = get_display_name (app, g_ptr_array_index (get_connected_outputs (app), i));
+	layout_set_font (layout, "Sans 12");
+	g_ptr_array_index (app->name_layouts, i) = layout;
+    }
+
+    return layout;
+}
+
+/* The background only changes with the size of the canvas and the theme, so
+ * it is drawn once into a surface that every paint just copies
+ */
+static cairo_surface_t *
+get_background (App *app, cairo_t *cr, int width, int height)
 {
-    CdkRectangle viewport;
-    CtkWidget *widget;
     CtkStyleContext *widget_style;
     CdkRGBA *base_color = NULL;
     CdkRGBA dark_color;
+    cairo_t *background_cr;
 
-    widget = CTK_WIDGET (area);
-
-    foo_scroll_area_get_viewport (area, &viewport);
-
-    widget_style = ctk_widget_get_style_context (widget);
+    widget_style = ctk_widget_get_style_context (app->area);
 
     ctk_style_context_save (widget_style);
     ctk_style_context_set_state (widget_style, CTK_STATE_FLAG_SELECTED);
@@ -1662,101 +1979,115 @@ paint_background (FooScrollArea *area,
                            ctk_style_context_get_state (widget_style),
                            CTK_STYLE_PROPERTY_BACKGROUND_COLOR, &base_color,
                            NULL);
+    cafe_desktop_ctk_style_get_dark_color (widget_style,
+                                           ctk_style_context_get_state (widget_style),
+                                           &dark_color);
     ctk_style_context_restore (widget_style);
-    cdk_cairo_set_source_rgba(cr, base_color);
+
+    if (app->background
+	&& app->background_width == width
+	&& app->background_height == height
+	&& cdk_rgba_equal (&app->background_color, base_color)
+	&& cdk_rgba_equal (&app->background_border_color, &dark_color))
+    {
+	cdk_rgba_free (base_color);
+	return app->background;
+    }
+
+    if (app->background)
+	cairo_surface_destroy (app->background);
+
+    app->background = cairo_surface_create_similar (cairo_get_target (cr), CAIRO_CONTENT_COLOR,
+						    MAX (width, 1), MAX (height, 1));
+    app->background_width = width;
+    app->background_height = height;
+    app->background_color = *base_color;
+    app->background_border_color = dark_color;
+
+    background_cr = cairo_create (app->background);
+
+    cdk_cairo_set_source_rgba (background_cr, base_color);
     cdk_rgba_free (base_color);
 
-    cairo_rectangle (cr,
-		     viewport.x, viewport.y,
-		     viewport.width, viewport.height);
+    cairo_rectangle (background_cr, 0, 0, width, height);
+    cairo_fill_preserve (background_cr);
 
-    cairo_fill_preserve (cr);
+    cdk_cairo_set_source_rgba (background_cr, &dark_color);
 
-    foo_scroll_area_add_input_from_fill (area, cr, on_canvas_event, NULL);
+    cairo_stroke (background_cr);
 
-    ctk_style_context_save (widget_style);
-    ctk_style_context_set_state (widget_style, CTK_STATE_FLAG_SELECTED);
-    cafe_desktop_ctk_style_get_dark_color (widget_style,
-                                           ctk_style_context_get_state (widget_style),
-                                           &dark_color);
-    ctk_style_context_restore (widget_style);
-    cdk_cairo_set_source_rgba (cr, &dark_color);
+    cairo_destroy (background_cr);
 
-    cairo_stroke (cr);
+    return app->background;
 }
 
 static void
-paint_output (App *app, cairo_t *cr, int i)
+paint_background (App *app,
+		  cairo_t *cr)
 {
-    int w, h;
-    double scale = compute_scale (app);
-    double x, y;
-    int output_x, output_y;
-    CafeRRRotation rotation;
-    int total_w, total_h;
-    GList *connected_outputs = list_connected_outputs (app, &total_w, &total_h);
-    CafeRROutputInfo *output = g_list_nth_data (connected_outputs, i);
-    PangoLayout *layout = get_display_name (app, output);
-    PangoRectangle ink_extent, log_extent;
     CdkRectangle viewport;
-    CdkRGBA output_color;
-    double r, g, b;
-    double available_w;
-    double factor;
-
-    cairo_save (cr);
 
     foo_scroll_area_get_viewport (FOO_SCROLL_AREA (app->area), &viewport);
 
-    get_geometry (output, &w, &h);
+    cairo_rectangle (cr,
+		     viewport.x, viewport.y,
+		     viewport.width, viewport.height);
 
-#if 0
-    g_debug ("%s (%p) geometry %d %d %d", output->name, output,
-	     w, h, output->rate);
-#endif
+    foo_scroll_area_add_input_from_fill (FOO_SCROLL_AREA (app->area), cr, on_canvas_event, NULL);
 
-    viewport.height -= 2 * MARGIN;
-    viewport.width -= 2 * MARGIN;
+    cairo_set_source_surface (cr, get_background (app, cr, viewport.width, viewport.height),
+			      viewport.x, viewport.y);
+    cairo_fill (cr);
+}
 
-    cafe_rr_output_info_get_geometry (output, &output_x, &output_y, NULL, NULL);
-    x = output_x * scale + MARGIN + (viewport.width - total_w * scale) / 2.0;
-    y = output_y * scale + MARGIN + (viewport.height - total_h * scale) / 2.0;
+typedef struct
+{
+    cairo_surface_t *surface;
 
-#if 0
-    g_debug ("scaled: %f %f", x, y);
+    /* What the surface was drawn for */
+    int width, height;
+    CdkRGBA color;
+    gboolean active;
+    gboolean current;
+    gboolean clone;
+    CafeRRRotation rotation;
+} OutputDecoration;
 
-    g_debug ("scale: %f", scale);
+static void
+output_decoration_free (OutputDecoration *decoration)
+{
+    cairo_surface_destroy (decoration->surface);
+    g_free (decoration);
+}
 
-    g_debug ("%f %f %f %f", x, y, w * scale + 0.5, h * scale + 0.5);
-#endif
+static void
+draw_output_decoration (OutputDecoration *decoration, PangoLayout *layout)
+{
+    PangoRectangle ink_extent, log_extent;
+    double r, g, b;
+    double available_w;
+    double factor;
+    int width = decoration->width;
+    int height = decoration->height;
+    cairo_t *cr = cairo_create (decoration->surface);
 
-    cairo_translate (cr,
-		     x + (w * scale + 0.5) / 2,
-		     y + (h * scale + 0.5) / 2);
+    cairo_translate (cr, width / 2.0, height / 2.0);
 
     /* rotation is already applied in get_geometry */
 
-    rotation = cafe_rr_output_info_get_rotation (output);
-    if (rotation & CAFE_RR_REFLECT_X)
+    if (decoration->rotation & CAFE_RR_REFLECT_X)
 	cairo_scale (cr, -1, 1);
 
-    if (rotation & CAFE_RR_REFLECT_Y)
+    if (decoration->rotation & CAFE_RR_REFLECT_Y)
 	cairo_scale (cr, 1, -1);
 
-    cairo_translate (cr,
-		     - x - (w * scale + 0.5) / 2,
-		     - y - (h * scale + 0.5) / 2);
-
+    cairo_translate (cr, - width / 2.0, - height / 2.0);
 
-    cairo_rectangle (cr, x, y, w * scale + 0.5, h * scale + 0.5);
-    cairo_clip_preserve (cr);
+    r = decoration->color.red;
+    g = decoration->color.green;
+    b = decoration->color.blue;
 
-    cafe_rr_labeler_get_rgba_for_output (app->labeler, output, &output_color);
-    r = output_color.red;
-    g = output_color.green;
-    b = output_color.blue;
-
-    if (!cafe_rr_output_info_is_active (output))
+    if (!decoration->active)
     {
 	/* If the output is turned off, just darken the selected color */
 	r *= 0.2;
@@ -1765,21 +2096,18 @@ paint_output (App *app, cairo_t *cr, int i)
     }
 
     cairo_set_source_rgba (cr, r, g, b, 1.0);
+    cairo_paint (cr);
 
-    foo_scroll_area_add_input_from_fill (FOO_SCROLL_AREA (app->area),
-					 cr, on_output_event, output);
-    cairo_fill (cr);
-
-    if (output == app->current_output)
+    if (decoration->current)
     {
-	cairo_rectangle (cr, x + 2, y + 2, w * scale + 0.5 - 4, h * scale + 0.5 - 4);
+	cairo_rectangle (cr, 2, 2, width - 4, height - 4);
 
 	cairo_set_line_width (cr, 4);
 	cairo_set_source_rgba (cr, 0.33, 0.43, 0.57, 1.0);
 	cairo_stroke (cr);
     }
 
-    cairo_rectangle (cr, x + 0.5, y + 0.5, w * scale + 0.5 - 1, h * scale + 0.5 - 1);
+    cairo_rectangle (cr, 0.5, 0.5, width - 1, height - 1);
 
     cairo_set_line_width (cr, 1);
     cairo_set_source_rgba (cr, 0.0, 0.0, 0.0, 1.0);
@@ -1787,31 +2115,134 @@ paint_output (App *app, cairo_t *cr, int i)
     cairo_stroke (cr);
     cairo_set_line_width (cr, 2);
 
-    layout_set_font (layout, "Sans 12");
     pango_layout_get_pixel_extents (layout, &ink_extent, &log_extent);
 
-    available_w = w * scale + 0.5 - 6; /* Same as the inner rectangle's width, minus 1 pixel of padding on each side */
+    available_w = width - 6; /* Same as the inner rectangle's width, minus 1 pixel of padding on each side */
     if (available_w < ink_extent.width)
 	factor = available_w / ink_extent.width;
     else
 	factor = 1.0;
 
     cairo_move_to (cr,
-		   x + ((w * scale + 0.5) - factor * log_extent.width) / 2,
-		   y + ((h * scale + 0.5) - factor * log_extent.height) / 2);
+		   (width - factor * log_extent.width) / 2,
+		   (height - factor * log_extent.height) / 2);
 
     cairo_scale (cr, factor, factor);
 
-    if (cafe_rr_output_info_is_active (output))
+    if (decoration->active)
 	cairo_set_source_rgb (cr, 0.0, 0.0, 0.0);
     else
 	cairo_set_source_rgb (cr, 1.0, 1.0, 1.0);
 
     pango_cairo_show_layout (cr, layout);
 
-    cairo_restore (cr);
+    cairo_destroy (cr);
+}
+
+/* The rectangle, frame and name of output @i are drawn into a surface that
+ * is reused as long as they look the same, so that dragging an output only
+ * copies pixels around
+ */
+static cairo_surface_t *
+get_output_decoration (App *app, cairo_t *cr, int i, int width, int height)
+{
+    CafeRROutputInfo *output = g_ptr_array_index (get_connected_outputs (app), i);
+    OutputDecoration *decoration;
+    CdkRGBA color;
+    gboolean active, current, clone;
+    CafeRRRotation rotation;
+
+    cafe_rr_labeler_get_rgba_for_output (app->labeler, output, &color);
+    active = cafe_rr_output_info_is_active (output);
+    current = output == app->current_output;
+    clone = cafe_rr_config_get_clone (app->current_configuration);
+    rotation = cafe_rr_output_info_get_rotation (output);
+
+    if (!app->output_decorations)
+    {
+	app->output_decorations = g_ptr_array_new_with_free_func ((GDestroyNotify) output_decoration_free);
+	g_ptr_array_set_size (app->output_decorations, get_n_connected (app));
+    }
+
+    decoration = g_ptr_array_index (app->output_decorations, i);
+    if (decoration)
+    {
+	if (decoration->width == width
+	    && decoration->height == height
+	    && cdk_rgba_equal (&decoration->color, &color)
+	    && decoration->active == active
+	    && decoration->current == current
+	    && decoration->clone == clone
+	    && decoration->rotation == rotation)
+	    return decoration->surface;
+
+	cairo_surface_destroy (decoration->surface);
+    }
+    else
+    {
+	decoration = g_new0 (OutputDecoration, 1);
+	g_ptr_array_index (app->output_decorations, i) = decoration;
+    }
+
+    decoration->surface = cairo_surface_create_similar (cairo_get_target (cr), CAIRO_CONTENT_COLOR,
+							MAX (width, 1), MAX (height, 1));
+    decoration->width = width;
+    decoration->height = height;
+    decoration->color = color;
+    decoration->active = active;
+    decoration->current = current;
+    decoration->clone = clone;
+    decoration->rotation = rotation;
+
+    draw_output_decoration (decoration, get_output_name_layout (app, i));
+
+    return decoration->surface;
+}
+
+static void
+paint_output (App *app, cairo_t *cr, int i, double scale, int total_w, int total_h)
+{
+    int w, h;
+    int x, y;
+    int width, height;
+    int output_x, output_y;
+    CafeRROutputInfo *output = g_ptr_array_index (get_connected_outputs (app), i);
+    CdkRectangle viewport;
+
+    foo_scroll_area_get_viewport (FOO_SCROLL_AREA (app->area), &viewport);
+
+    get_geometry (output, &w, &h);
+
+#if 0
+    g_debug ("%s (%p) geometry %d %d %d", output->name, output,
+	     w, h, output->rate);
+#endif
+
+    viewport.height -= 2 * MARGIN;
+    viewport.width -= 2 * MARGIN;
+
+    /* The decoration is copied to whole pixels so that it stays sharp */
+    cafe_rr_output_info_get_geometry (output, &output_x, &output_y, NULL, NULL);
+    x = output_x * scale + MARGIN + (viewport.width - total_w * scale) / 2.0;
+    y = output_y * scale + MARGIN + (viewport.height - total_h * scale) / 2.0;
+    width = w * scale + 0.5;
+    height = h * scale + 0.5;
+
+#if 0
+    g_debug ("scaled: %d %d", x, y);
+
+    g_debug ("scale: %f", scale);
+
+    g_debug ("%d %d %d %d", x, y, width, height);
+#endif
+
+    cairo_rectangle (cr, x, y, width, height);
+
+    foo_scroll_area_add_input_from_fill (FOO_SCROLL_AREA (app->area),
+					 cr, on_output_event, output);
 
-    g_object_unref (layout);
+    cairo_set_source_surface (cr, get_output_decoration (app, cr, i, width, height), x, y);
+    cairo_fill (cr);
 }
 
 static void
@@ -1820,25 +2251,29 @@ on_area_paint (FooScrollArea *area,
 	       gpointer	      data)
 {
     App *app = data;
-    GList *connected_outputs = NULL;
-    GList *list;
+    int n_connected;
+    int total_w, total_h;
+    double scale;
+    int i;
 
-    paint_background (area, cr);
+    paint_background (app, cr);
 
     if (!app->current_configuration)
 	return;
 
-    connected_outputs = list_connected_outputs (app, NULL, NULL);
+    n_connected = get_n_connected (app);
+
+    /* the same for all the outputs, so only worked out once per paint */
+    get_total_size (app, &total_w, &total_h);
+    scale = compute_scale_for_size (app, total_w, total_h);
 
 #if 0
-    double scale;
-    scale = compute_scale (app);
     g_debug ("scale: %f", scale);
 #endif
 
-    for (list = connected_outputs; list != NULL; list = list->next)
+    for (i = 0; i < n_connected; ++i)
     {
-	paint_output (app, cr, g_list_position (connected_outputs, list));
+	paint_output (app, cr, i, scale, total_w, total_h);
 
 	if (cafe_rr_config_get_clone (app->current_configuration))
 	    break;
@@ -1849,33 +2284,20 @@ static void
 make_text_combo (CtkWidget *widget, int sort_column)
 {
     CtkComboBox *box = CTK_COMBO_BOX (widget);
-    CtkListStore *store = ctk_list_store_new (
-	6,
-	G_TYPE_STRING,		/* Text */
-	G_TYPE_INT,		/* Width */
-	G_TYPE_INT,		/* Height */
-	G_TYPE_INT,		/* Frequency */
-	G_TYPE_INT,		/* Width * Height */
-	G_TYPE_INT);		/* Rotation */
+    CtkListStore *store = new_combo_store (sort_column);
 
     CtkCellRenderer *cell;
 
     ctk_cell_layout_clear (CTK_CELL_LAYOUT (widget));
 
     ctk_combo_box_set_model (box, CTK_TREE_MODEL (store));
+    g_object_unref (store);
 
     cell = ctk_cell_renderer_text_new ();
     ctk_cell_layout_pack_start (CTK_CELL_LAYOUT (box), cell, TRUE);
     ctk_cell_layout_set_attributes (CTK_CELL_LAYOUT (box), cell,
 				    "text", 0,
 				    NULL);
-
-    if (sort_column != -1)
-    {
-	ctk_tree_sortable_set_sort_column_id (CTK_TREE_SORTABLE (store),
-					      sort_column,
-					      CTK_SORT_DESCENDING);
-    }
 }
 
 static void
@@ -1932,90 +2354,141 @@ check_required_virtual_size (App *app)
     }
 }
 
+static void apply_configuration_proxy_ready_cb (GObject *source_object, GAsyncResult *res, gpointer data);
+
 static void
-begin_version2_apply_configuration (App *app, CdkWindow *parent_window, guint32 timestamp)
+begin_version2_apply_configuration (App *app)
 {
-    XID parent_window_xid;
-    GError *error = NULL;
+    app->apply_configuration_state = APPLYING_VERSION_2;
+    g_dbus_proxy_new (app->connection,
+                      G_DBUS_PROXY_FLAGS_NONE,
+                      NULL,
+                      "org.cafe.SettingsDaemon",
+                      "/org/cafe/SettingsDaemon/XRANDR",
+                      "org.cafe.SettingsDaemon.XRANDR_2",
+                      app->apply_cancellable,
+                      (GAsyncReadyCallback) apply_configuration_proxy_ready_cb,
+                      app);
+}
 
-    parent_window_xid = CDK_WINDOW_XID (parent_window);
+static void
+begin_version1_apply_configuration (App *app)
+{
+    app->apply_configuration_state = APPLYING_VERSION_1;
+    g_dbus_proxy_new (app->connection,
+                      G_DBUS_PROXY_FLAGS_NONE,
+                      NULL,
+                      "org.cafe.SettingsDaemon",
+                      "/org/cafe/SettingsDaemon/XRANDR",
+                      "org.cafe.SettingsDaemon.XRANDR",
+                      app->apply_cancellable,
+                      (GAsyncReadyCallback) apply_configuration_proxy_ready_cb,
+                      app);
+}
 
-    app->proxy = g_dbus_proxy_new_sync (app->connection,
-                                        G_DBUS_PROXY_FLAGS_NONE,
-                                        NULL,
-                                        "org.cafe.SettingsDaemon",
-                                        "/org/cafe/SettingsDaemon/XRANDR",
-                                        "org.cafe.SettingsDaemon.XRANDR_2",
-                                        NULL,
-                                        &error);
-    if (app->proxy == NULL) {
-        g_warning ("Failed to get dbus connection: %s", error->message);
-        g_error_free (error);
-    } else {
-        app->apply_configuration_state = APPLYING_VERSION_2;
-        g_dbus_proxy_call (app->proxy,
-                           "ApplyConfiguration",
-                           g_variant_new ("(xx)", parent_window_xid, timestamp),
-                           G_DBUS_CALL_FLAGS_NONE,
-                           -1,
-                           NULL,
-                           (GAsyncReadyCallback) apply_configuration_returned_cb,
-                           app);
-    }
+/* While a configuration is being applied the user can't change it, but the
+ * dialog keeps running so that it can still be closed
+ */
+static void
+set_applying (App *app, gboolean applying)
+{
+    ctk_widget_set_sensitive (app->options_grid, !applying);
+    ctk_dialog_set_response_sensitive (CTK_DIALOG (app->dialog), CTK_RESPONSE_APPLY, !applying);
+    ctk_dialog_set_response_sensitive (CTK_DIALOG (app->dialog), RESPONSE_MAKE_DEFAULT, !applying);
+
+    set_cursor (app->dialog, applying ? CDK_WATCH : CDK_BLANK_CURSOR);
 }
 
+/* A configuration saved but never applied must not stay in monitors.xml: it
+ * would be applied at the next login, without the daemon asking the user to
+ * confirm it.  This puts back what the file had before, the same way the
+ * daemon does when the user doesn't confirm.
+ */
 static void
-begin_version1_apply_configuration (App *app)
+discard_unsent_configuration (App *app)
 {
-    GError *error = NULL;
+    gchar *backup_filename;
+    gchar *intended_filename;
 
-    app->proxy = g_dbus_proxy_new_sync (app->connection,
-                                        G_DBUS_PROXY_FLAGS_NONE,
-                                        NULL,
-                                        "org.cafe.SettingsDaemon",
-                                        "/org/cafe/SettingsDaemon/XRANDR",
-                                        "org.cafe.SettingsDaemon.XRANDR",
-                                        NULL,
-                                        &error);
-    if (app->proxy == NULL) {
-        g_warning ("Failed to get dbus connection: %s", error->message);
-        g_error_free (error);
-    } else {
-        app->apply_configuration_state = APPLYING_VERSION_1;
-        g_dbus_proxy_call (app->proxy,
-                           "ApplyConfiguration",
-                           g_variant_new ("()"),
-                           G_DBUS_CALL_FLAGS_NONE,
-                           -1,
-                           NULL,
-                           (GAsyncReadyCallback) apply_configuration_returned_cb,
-                           app);
+    if (!app->apply_unsent)
+	return;
+
+    app->apply_unsent = FALSE;
+
+    backup_filename = cafe_rr_config_get_backup_filename ();
+    intended_filename = cafe_rr_config_get_intended_filename ();
+
+    if (g_rename (backup_filename, intended_filename) != 0)
+    {
+	/* no backup means there was no monitors.xml before */
+	if (errno == ENOENT)
+	    g_unlink (intended_filename);
+	else
+	    g_warning ("Could not restore %s: %s", intended_filename, g_strerror (errno));
     }
+
+    g_free (backup_filename);
+    g_free (intended_filename);
 }
 
 static void
-ensure_current_configuration_is_saved (void)
+finish_apply (App *app)
+{
+    discard_unsent_configuration (app);
+
+    if (app->proxy)
+    {
+	g_object_unref (app->proxy);
+	app->proxy = NULL;
+    }
+
+    if (app->connection)
+    {
+	g_object_unref (app->connection);
+	app->connection = NULL;
+    }
+
+    g_object_unref (app->apply_cancellable);
+    app->apply_cancellable = NULL;
+
+    set_applying (app, FALSE);
+}
+
+/* Normally, cafe_rr_config_save() creates a backup file based on the
+ * old monitors.xml.  However, if *that* file didn't exist, there is
+ * nothing from which to create a backup.  So, here we get the
+ * current/unchanged configuration, to be saved before the new/changed
+ * configuration so that there *will* be a backup file in the end.
+ */
+static CafeRRConfig *
+get_unchanged_configuration (void)
 {
         CafeRRScreen *rr_screen;
         CafeRRConfig *rr_config;
 
-        /* Normally, cafe_rr_config_save() creates a backup file based on the
-         * old monitors.xml.  However, if *that* file didn't exist, there is
-         * nothing from which to create a backup.  So, here we'll save the
-         * current/unchanged configuration and then let our caller call
-         * cafe_rr_config_save() again with the new/changed configuration, so
-         * that there *will* be a backup file in the end.
-         */
-
         rr_screen = cafe_rr_screen_new (cdk_screen_get_default (), NULL); /* NULL-GError */
         if (!rr_screen)
-                return;
+                return NULL;
 
         rr_config = cafe_rr_config_new_current (rr_screen, NULL);
+
+        g_object_unref (rr_screen);
+
+        return rr_config;
+}
+
+static void
+ensure_current_configuration_is_saved (void)
+{
+        CafeRRConfig *rr_config;
+
+        rr_config = get_unchanged_configuration ();
+        if (!rr_config)
+                return;
+
         cafe_rr_config_save (rr_config, NULL); /* NULL-GError */
 
         g_object_unref (rr_config);
-        g_object_unref (rr_screen);
 }
 
 /* Callback for g_dbus_proxy_call() */
@@ -2042,6 +2515,8 @@ apply_configuration_returned_cb (GObject *source_object,
             g_object_unref (app->proxy);
             app->proxy = NULL;
 
+            /* the daemon didn't act on the call */
+            app->apply_unsent = TRUE;
             begin_version1_apply_configuration (app);
             return;
         } else {
@@ -2050,27 +2525,68 @@ apply_configuration_returned_cb (GObject *source_object,
              */
             g_error_free (error);
         }
+    } else {
+        g_variant_unref (variant);
     }
 
-    g_object_unref (app->proxy);
-    app->proxy = NULL;
+    finish_apply (app);
+}
 
-    g_object_unref (app->connection);
-    app->connection = NULL;
+/* Callback for g_dbus_proxy_new() */
+static void
+apply_configuration_proxy_ready_cb (GObject *source_object,
+                                    GAsyncResult *res,
+                                    gpointer data)
+{
+    GVariant *parameters;
+    GError *error = NULL;
+    App *app = data;
 
-    ctk_widget_set_sensitive (app->dialog, TRUE);
+    app->proxy = g_dbus_proxy_new_finish (res, &error);
+    if (app->proxy == NULL) {
+        if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            g_warning ("Failed to get dbus connection: %s", error->message);
+        g_error_free (error);
+        finish_apply (app);
+        return;
+    }
+
+    if (app->apply_configuration_state == APPLYING_VERSION_2) {
+        XID parent_window_xid = CDK_WINDOW_XID (ctk_widget_get_window (app->dialog));
+
+        parameters = g_variant_new ("(xx)", (gint64) parent_window_xid, (gint64) app->apply_button_clicked_timestamp);
+    } else {
+        parameters = g_variant_new ("()");
+    }
+
+    /* from here on, the daemon takes care of confirming or reverting */
+    app->apply_unsent = FALSE;
+    g_dbus_proxy_call (app->proxy,
+                       "ApplyConfiguration",
+                       parameters,
+                       G_DBUS_CALL_FLAGS_NONE,
+                       -1,
+                       app->apply_cancellable,
+                       (GAsyncReadyCallback) apply_configuration_returned_cb,
+                       app);
 }
 
-static gboolean
-sanitize_and_save_configuration (App *app)
+static void
+sanitize_configuration (App *app)
 {
-    GError *error;
-
     cafe_rr_config_sanitize (app->current_configuration);
 
     check_required_virtual_size (app);
 
     foo_scroll_area_invalidate (FOO_SCROLL_AREA (app->area));
+}
+
+static gboolean
+sanitize_and_save_configuration (App *app)
+{
+    GError *error;
+
+    sanitize_configuration (app);
 
     ensure_current_configuration_is_saved ();
 
@@ -2085,27 +2601,168 @@ sanitize_and_save_configuration (App *app)
     return TRUE;
 }
 
+typedef struct
+{
+    CafeRRConfig *unchanged;	/* May be NULL */
+    CafeRRConfig *config;
+} SaveData;
+
 static void
-apply (App *app)
+save_data_free (SaveData *data)
+{
+    if (data->unchanged)
+	g_object_unref (data->unchanged);
+    g_object_unref (data->config);
+    g_free (data);
+}
+
+/* Runs in a thread, so that a slow home directory doesn't block the dialog;
+ * it only gets configurations the dialog doesn't hold on to
+ */
+static void
+save_configuration_thread (GTask        *task,
+			   gpointer      source_object,
+			   gpointer      task_data,
+			   GCancellable *cancellable)
 {
+    SaveData *data = task_data;
     GError *error = NULL;
 
-    if (!sanitize_and_save_configuration (app))
+    if (data->unchanged)
+	cafe_rr_config_save (data->unchanged, NULL); /* NULL-GError */
+
+    if (g_task_return_error_if_cancelled (task))
 	return;
 
-    g_assert (app->connection == NULL);
-    g_assert (app->proxy == NULL);
+    if (!cafe_rr_config_save (data->config, &error))
+	g_task_return_error (task, error);
+    else
+	g_task_return_boolean (task, TRUE);
+}
+
+static void
+apply_session_bus_ready_cb (GObject *source_object,
+			    GAsyncResult *res,
+			    gpointer data)
+{
+    GError *error = NULL;
+    App *app = data;
 
-    app->connection = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, &error);
+    app->connection = g_bus_get_finish (res, &error);
     if (app->connection == NULL) {
-        error_message (app, _("Could not get session bus while applying display configuration"), error->message);
+        if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            error_message (app, _("Could not get session bus while applying display configuration"), error->message);
         g_error_free (error);
+        finish_apply (app);
         return;
     }
 
-    ctk_widget_set_sensitive (app->dialog, FALSE);
+    begin_version2_apply_configuration (app);
+}
+
+static void
+configuration_saved_cb (GObject *source_object,
+			GAsyncResult *res,
+			gpointer data)
+{
+    GError *error = NULL;
+    App *app = data;
+
+    app->apply_saving = FALSE;
+
+    if (!g_task_propagate_boolean (G_TASK (res), &error))
+    {
+	if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+	    error_message (app, _("Could not save the monitor configuration"), error->message);
+	g_error_free (error);
+	finish_apply (app);
+	return;
+    }
+
+    app->apply_unsent = TRUE;
+
+    /* the dialog was closed while saving, and is going away now */
+    if (g_cancellable_is_cancelled (app->apply_cancellable))
+	return;
+
+    g_bus_get (G_BUS_TYPE_SESSION, app->apply_cancellable,
+	       apply_session_bus_ready_cb, app);
+}
+
+/* CafeRRConfig can't be copied as such: this reads a configuration from the
+ * screen, which has the same outputs, and gives them the settings of config
+ */
+static CafeRRConfig *
+copy_configuration (App *app, CafeRRConfig *config, GError **error)
+{
+    CafeRRConfig *copy;
+    CafeRROutputInfo **outputs;
+    int i;
+
+    copy = cafe_rr_config_new_current (app->screen, error);
+    if (!copy)
+	return NULL;
+
+    outputs = cafe_rr_config_get_outputs (copy);
+    for (i = 0; outputs[i] != NULL; ++i)
+    {
+	CafeRROutputInfo *output;
+	int x, y, width, height;
+
+	output = find_output_by_name (config, cafe_rr_output_info_get_name (outputs[i]));
+	if (!output)
+	    continue;
+
+	cafe_rr_output_info_get_geometry (output, &x, &y, &width, &height);
+
+	cafe_rr_output_info_set_active (outputs[i], cafe_rr_output_info_is_active (output));
+	cafe_rr_output_info_set_geometry (outputs[i], x, y, width, height);
+	cafe_rr_output_info_set_rotation (outputs[i], cafe_rr_output_info_get_rotation (output));
+	cafe_rr_output_info_set_refresh_rate (outputs[i], cafe_rr_output_info_get_refresh_rate (output));
+	cafe_rr_output_info_set_primary (outputs[i], cafe_rr_output_info_get_primary (output));
+    }
+
+    cafe_rr_config_set_clone (copy, cafe_rr_config_get_clone (config));
+
+    return copy;
+}
+
+static void
+apply (App *app)
+{
+    SaveData *data;
+    CafeRRConfig *config;
+    GTask *task;
+    GError *error = NULL;
+
+    g_assert (app->apply_cancellable == NULL);
+    g_assert (app->connection == NULL);
+    g_assert (app->proxy == NULL);
+
+    sanitize_configuration (app);
+
+    config = copy_configuration (app, app->current_configuration, &error);
+    if (!config)
+    {
+	error_message (app, _("Could not save the monitor configuration"), error->message);
+	g_error_free (error);
+	return;
+    }
+
+    app->apply_cancellable = g_cancellable_new ();
+    app->apply_saving = TRUE;
+    set_applying (app, TRUE);
+
+    data = g_new0 (SaveData, 1);
+    data->unchanged = get_unchanged_configuration ();
+    data->config = config;
 
-    begin_version2_apply_configuration (app, ctk_widget_get_window (app->dialog), app->apply_button_clicked_timestamp);
+    task = g_task_new (NULL, app->apply_cancellable, configuration_saved_cb, app);
+    g_task_set_task_data (task, data, (GDestroyNotify) save_data_free);
+    /* a cancelled apply still has to learn whether monitors.xml was written */
+    g_task_set_check_cancellable (task, FALSE);
+    g_task_run_in_thread (task, save_configuration_thread);
+    g_object_unref (task);
 }
 
 static void
@@ -2397,6 +3054,11 @@ run_application (App *app)
 
     app->settings = g_settings_new (CSD_XRANDR_SCHEMA);
 
+    app->resolution_stores = g_hash_table_new_full (g_str_hash, g_str_equal,
+						    g_free, g_object_unref);
+    app->rate_stores = g_hash_table_new_full (g_str_hash, g_str_equal,
+					      g_free, g_object_unref);
+
     app->dialog = _ctk_builder_get_widget (builder, "dialog");
     g_signal_connect_after (app->dialog, "map-event",
 			    G_CALLBACK (dialog_map_event_cb), app);
@@ -2440,6 +3102,7 @@ run_application (App *app)
 		      "clicked", G_CALLBACK (on_detect_displays), app);
 
     app->primary_button = _ctk_builder_get_widget (builder, "primary_button");
+    app->options_grid = _ctk_builder_get_widget (builder, "table2");
 
     g_signal_connect (app->primary_button, "clicked", G_CALLBACK (set_primary), app);
 
@@ -2482,7 +3145,7 @@ run_application (App *app)
     g_signal_connect (app->apply_button, "clicked",
 		      G_CALLBACK (apply_button_clicked_cb), app);
 
-    on_screen_changed (app->screen, app);
+    update_from_screen (app);
 
     g_object_unref (builder);
 
@@ -2522,9 +3185,32 @@ restart:
 	break;
     }
 
+    /* The pending callbacks of an apply won't run anymore.  A save in progress
+     * is waited for, so that a configuration it wrote but that was never sent
+     * to the daemon can be taken back out of monitors.xml.
+     */
+    if (app->apply_cancellable)
+    {
+	g_cancellable_cancel (app->apply_cancellable);
+
+	while (app->apply_saving)
+	    g_main_context_iteration (NULL, TRUE);
+
+	discard_unsent_configuration (app);
+    }
+
+    if (app->screen_changed_id)
+	g_source_remove (app->screen_changed_id);
+
+    invalidate_connected_outputs (app);
+    if (app->background)
+	cairo_surface_destroy (app->background);
+
     ctk_widget_destroy (app->dialog);
     g_object_unref (app->screen);
     g_object_unref (app->settings);
+    g_hash_table_destroy (app->resolution_stores);
+    g_hash_table_destroy (app->rate_stores);
 }
 
 int
@@ -34,6 +34,9 @@
 #define PIN_HOT_POINT_X 8
 #define PIN_HOT_POINT_Y 15
 
+/* Size in pixels of the cells the locations are bucketed in */
+#define CITY_CELL_SIZE 16
+
 typedef struct
 {
     gdouble offset;
@@ -104,6 +107,12 @@ cc_timezone_map_dispose (GObject *object)
     g_clear_object (&self->pin);
     g_clear_pointer (&self->bubble_text, g_free);
 
+    if (self->hilight_cancellable)
+        g_cancellable_cancel (self->hilight_cancellable);
+    g_clear_object (&self->hilight_cancellable);
+    g_clear_pointer (&self->hilights, g_hash_table_destroy);
+    g_clear_pointer (&self->pending_hilights, g_hash_table_destroy);
+
     if (self->color_map)
     {
         g_clear_object (&self->color_map);
@@ -120,6 +129,9 @@ timezone_map_finalize (GObject *object)
     TimezoneMap *self = TIMEZONEMAP (object);
 
     g_clear_pointer (&self->tzdb, TimeZoneDateBaseFree);
+    g_clear_pointer (&self->city_points, g_free);
+    g_clear_pointer (&self->city_cells, g_free);
+    g_clear_pointer (&self->city_indices, g_free);
 
     G_OBJECT_CLASS (timezone_map_parent_class)->finalize (object);
 }
@@ -154,13 +166,173 @@ cc_timezone_map_get_preferred_height (CtkWidget *widget,
     if (natural != NULL)
         *natural = size;
 }
+static gdouble convert_longitude_to_x (gdouble longitude, gint map_width);
+static gdouble convert_latitude_to_y (gdouble latitude, gdouble map_height);
+
+static gint
+get_city_cell (TimezoneMap *map,
+               gdouble      x,
+               gdouble      y)
+{
+    gint col, row;
+
+    /* locations off the map go to the cells at its edge */
+    col = CLAMP ((gint) floor (x / CITY_CELL_SIZE), 0, map->city_cols - 1);
+    row = CLAMP ((gint) floor (y / CITY_CELL_SIZE), 0, map->city_rows - 1);
+
+    return row * map->city_cols + col;
+}
+
+static void
+update_city_grid (TimezoneMap *map,
+                  gint         width,
+                  gint         height)
+{
+    GPtrArray *locations;
+    guint *cell_of;
+    guint *next;
+    guint n_cells;
+    guint i;
+
+    locations = tz_get_locations (map->tzdb);
+
+    g_free (map->city_points);
+    g_free (map->city_cells);
+    g_free (map->city_indices);
+
+    map->city_cols = MAX (width, 1) / CITY_CELL_SIZE + 1;
+    map->city_rows = MAX (height, 1) / CITY_CELL_SIZE + 1;
+    n_cells = map->city_cols * map->city_rows;
+
+    map->city_points = g_new (gdouble, 2 * locations->len);
+    map->city_cells = g_new0 (guint, n_cells + 1);
+    map->city_indices = g_new (guint, locations->len);
+    cell_of = g_new (guint, locations->len);
+
+    /* count the locations of every cell... */
+    for (i = 0; i < locations->len; i++)
+    {
+        TzLocation *loc = locations->pdata[i];
+        gdouble x, y;
+
+        x = convert_longitude_to_x (loc->longitude, width);
+        y = convert_latitude_to_y (loc->latitude, height);
+
+        map->city_points[2 * i] = x;
+        map->city_points[2 * i + 1] = y;
+
+        cell_of[i] = get_city_cell (map, x, y);
+        map->city_cells[cell_of[i] + 1]++;
+    }
+
+    /* ...so that cell c holds city_indices[city_cells[c]] up to city_indices[city_cells[c + 1]] */
+    for (i = 0; i < n_cells; i++)
+        map->city_cells[i + 1] += map->city_cells[i];
+
+    next = g_new (guint, n_cells);
+    for (i = 0; i < n_cells; i++)
+        next[i] = map->city_cells[i];
+
+    for (i = 0; i < locations->len; i++)
+        map->city_indices[next[cell_of[i]]++] = i;
+
+    g_free (next);
+    g_free (cell_of);
+}
+
+static TzLocation *
+get_nearest_location (TimezoneMap *map,
+                      gdouble      x,
+                      gdouble      y)
+{
+    GPtrArray *locations;
+    TzLocation *nearest = NULL;
+    gdouble nearest_dist = G_MAXDOUBLE;
+    gint cell, col, row;
+    gint r;
+
+    if (!map->city_cells)
+        return NULL;
+
+    locations = tz_get_locations (map->tzdb);
+
+    cell = get_city_cell (map, x, y);
+    col = cell % map->city_cols;
+    row = cell / map->city_cols;
+
+    /* Search the rings of cells around the point's cell; whatever is in
+     * the cells beyond ring r is at least r cells away
+     */
+    for (r = 0; r <= MAX (map->city_cols, map->city_rows); r++)
+    {
+        gint c, w;
+
+        for (w = MAX (row - r, 0); w <= MIN (row + r, map->city_rows - 1); w++)
+        {
+            gboolean edge = (w == row - r || w == row + r);
+
+            for (c = col - r; c <= col + r; c += edge ? 1 : 2 * r)
+            {
+                guint k;
+
+                if (c < 0 || c >= map->city_cols)
+                    continue;
+
+                cell = w * map->city_cols + c;
+                for (k = map->city_cells[cell]; k < map->city_cells[cell + 1]; k++)
+                {
+                    guint i = map->city_indices[k];
+                    gdouble dx, dy, dist;
+
+                    dx = map->city_points[2 * i] - x;
+                    dy = map->city_points[2 * i + 1] - y;
+                    dist = dx * dx + dy * dy;
+
+                    if (dist < nearest_dist)
+                    {
+                        nearest_dist = dist;
+                        nearest = locations->pdata[i];
+                    }
+                }
+            }
+        }
+
+        if (nearest && nearest_dist <= (gdouble) (r * CITY_CELL_SIZE) * (r * CITY_CELL_SIZE))
+            break;
+    }
+
+    return nearest;
+}
+
+static void
+reset_hilights (TimezoneMap *map)
+{
+    g_cancellable_cancel (map->hilight_cancellable);
+    g_object_unref (map->hilight_cancellable);
+    map->hilight_cancellable = g_cancellable_new ();
+
+    g_hash_table_remove_all (map->hilights);
+    g_hash_table_remove_all (map->pending_hilights);
+}
+
 static void
 cc_timezone_map_size_allocate (CtkWidget     *widget,
                                CtkAllocation *allocation)
 {
     TimezoneMap *map = TIMEZONEMAP (widget);
+    CtkAllocation old_allocation;
     GdkPixbuf *pixbuf;
 
+    /* the highlights and the city positions depend on the allocation */
+    ctk_widget_get_allocation (widget, &old_allocation);
+    if (old_allocation.width != allocation->width ||
+        old_allocation.height != allocation->height ||
+        !map->city_cells)
+    {
+        update_city_grid (map, allocation->width, allocation->height);
+        reset_hilights (map);
+    }
+
     if (map->background)
         g_object_unref (map->background);
 
@@ -322,56 +494,300 @@ draw_text_bubble (cairo_t *cr,
     cairo_restore (cr);
 }
 
-static gboolean
-cc_timezone_map_draw (CtkWidget *widget,
-                      cairo_t   *cr)
+/* missing highlights are cached as NULL */
+static void
+free_hilight (gpointer data)
+{
+    if (data)
+        cairo_surface_destroy (data);
+}
+
+static gchar *
+get_hilight_file (gdouble offset, gboolean dim)
 {
-    TimezoneMap *map = TIMEZONEMAP (widget);
-    g_autoptr(GdkPixbuf) orig_hilight = NULL;
-    CtkAllocation alloc;
-    g_autofree gchar *file = NULL;
-    g_autoptr(GError) err = NULL;
-    gdouble pointx, pointy;
     char buf[16];
 
-    ctk_widget_get_allocation (widget, &alloc);
+    if (dim)
+    {
+        return g_strdup_printf (TIMPZONEDIR"timezone_%s_dim.png",
+                                g_ascii_formatd (buf, sizeof (buf),
+                               "%g", offset));
+    }
 
-    /* paint background */
-    cdk_cairo_set_source_pixbuf (cr, map->background, 0, 0);
-    cairo_paint (cr);
+    return g_strdup_printf (TIMPZONEDIR"timezone_%s.png",
+                            g_ascii_formatd (buf, sizeof (buf),
+                           "%g", offset));
+}
 
-    /* paint hilight */
-    if (ctk_widget_is_sensitive (widget))
+/* Stores the selected offset followed by the ones next to it, which are the
+ * likely next selections, and returns how many were stored
+ */
+static guint
+get_wanted_offsets (TimezoneMap *map,
+                    gdouble      offsets[3])
+{
+    guint n_offsets = 0;
+    guint i, j;
+
+    offsets[n_offsets++] = map->selected_offset;
+
+    for (i = 0; color_codes[i].offset != -100; i++)
     {
-        file = g_strdup_printf (TIMPZONEDIR"timezone_%s.png",
-                                g_ascii_formatd (buf, sizeof (buf),
-                               "%g", map->selected_offset));
+        gdouble adjacent[2];
+
+        if (color_codes[i].offset != map->selected_offset)
+            continue;
+
+        adjacent[0] = i > 0 ? color_codes[i - 1].offset : -100;
+        adjacent[1] = color_codes[i + 1].offset;
+
+        for (j = 0; j < G_N_ELEMENTS (adjacent); j++)
+        {
+            if (adjacent[j] == -100 || adjacent[j] == map->selected_offset)
+                continue;
+
+            /* an offset split over two entries has the same neighbours twice */
+            if (n_offsets < 3 && (n_offsets < 2 || offsets[1] != adjacent[j]))
+                offsets[n_offsets++] = adjacent[j];
+        }
     }
-    else
+
+    return n_offsets;
+}
+
+/* Drops every highlight but those of the selected offset and its neighbours */
+static void
+prune_hilights (TimezoneMap *map,
+                gboolean     dim)
+{
+    GHashTableIter iter;
+    gpointer key;
+    gchar *wanted[3];
+    gdouble offsets[3];
+    guint n_offsets;
+    guint i;
+
+    n_offsets = get_wanted_offsets (map, offsets);
+    for (i = 0; i < n_offsets; i++)
+        wanted[i] = get_hilight_file (offsets[i], dim);
+
+    g_hash_table_iter_init (&iter, map->hilights);
+    while (g_hash_table_iter_next (&iter, &key, NULL))
     {
-        file = g_strdup_printf (TIMPZONEDIR"timezone_%s_dim.png",
-                                g_ascii_formatd (buf, sizeof (buf),
-                               "%g", map->selected_offset));
+        gboolean keep = FALSE;
+
+        for (i = 0; i < n_offsets && !keep; i++)
+            keep = g_str_equal (key, wanted[i]);
+
+        if (!keep)
+            g_hash_table_iter_remove (&iter);
     }
 
-    orig_hilight = gdk_pixbuf_new_from_file (file, &err);
+    for (i = 0; i < n_offsets; i++)
+        g_free (wanted[i]);
+}
 
+static GdkPixbuf *
+load_hilight (const gchar *file,
+              gint         width,
+              gint         height,
+              gint         scale,
+              GError     **error)
+{
+    g_autoptr(GdkPixbuf) orig_hilight = NULL;
+
+    orig_hilight = gdk_pixbuf_new_from_file (file, error);
     if (!orig_hilight)
+        return NULL;
+
+    return gdk_pixbuf_scale_simple (orig_hilight, width * scale, height * scale,
+                                    GDK_INTERP_BILINEAR);
+}
+
+typedef struct
+{
+    gchar *file;
+    gboolean dim;
+    gint width;
+    gint height;
+    gint scale;
+} HilightRequest;
+
+static void
+hilight_request_free (HilightRequest *request)
+{
+    g_free (request->file);
+    g_free (request);
+}
+
+static void
+prescale_hilight_thread (GTask        *task,
+                         gpointer      source_object,
+                         gpointer      task_data,
+                         GCancellable *cancellable)
+{
+    HilightRequest *request = task_data;
+    GdkPixbuf *hilight;
+    GError *err = NULL;
+
+    hilight = load_hilight (request->file, request->width, request->height,
+                            request->scale, &err);
+    if (!hilight)
+        g_task_return_error (task, err);
+    else
+        g_task_return_pointer (task, hilight, g_object_unref);
+}
+
+static void
+prescale_hilight_cb (GObject      *source_object,
+                     GAsyncResult *res,
+                     gpointer      user_data)
+{
+    TimezoneMap *map = TIMEZONEMAP (source_object);
+    HilightRequest *request = g_task_get_task_data (G_TASK (res));
+    g_autoptr(GdkPixbuf) hilight = NULL;
+
+    /* fails when cancelled by a resize, which also dropped the pending entry */
+    hilight = g_task_propagate_pointer (G_TASK (res), NULL);
+    if (!hilight)
+        return;
+
+    g_hash_table_remove (map->pending_hilights, request->file);
+
+    /* the surface is made here once, so drawing it needs no conversion */
+    if (!g_hash_table_contains (map->hilights, request->file))
+        g_hash_table_insert (map->hilights, g_strdup (request->file),
+                             cdk_cairo_surface_create_from_pixbuf (hilight, request->scale, NULL));
+
+    /* the selection may have moved on while this was loading */
+    prune_hilights (map, request->dim);
+}
+
+static void
+prescale_hilight (TimezoneMap *map,
+                  gdouble      offset,
+                  gboolean     dim,
+                  gint         width,
+                  gint         height)
+{
+    HilightRequest *request;
+    g_autoptr(GTask) task = NULL;
+    gchar *file;
+
+    file = get_hilight_file (offset, dim);
+
+    if (g_hash_table_contains (map->hilights, file) ||
+        g_hash_table_contains (map->pending_hilights, file))
+    {
+        g_free (file);
+        return;
+    }
+
+    g_hash_table_add (map->pending_hilights, g_strdup (file));
+
+    request = g_new0 (HilightRequest, 1);
+    request->file = file;
+    request->dim = dim;
+    request->width = width;
+    request->height = height;
+    request->scale = map->hilight_scale;
+
+    task = g_task_new (map, map->hilight_cancellable, prescale_hilight_cb, NULL);
+    g_task_set_task_data (task, request, (GDestroyNotify) hilight_request_free);
+    g_task_run_in_thread (task, prescale_hilight_thread);
+}
+
+static void
+prescale_adjacent_hilights (TimezoneMap *map,
+                            gboolean     dim,
+                            gint         width,
+                            gint         height)
+{
+    gdouble offsets[3];
+    guint n_offsets;
+    guint i;
+
+    n_offsets = get_wanted_offsets (map, offsets);
+
+    /* the first one is the selected offset, which is loaded when drawn */
+    for (i = 1; i < n_offsets; i++)
+        prescale_hilight (map, offsets[i], dim, width, height);
+}
+
+static cairo_surface_t *
+get_hilight (TimezoneMap *map,
+             gboolean     dim,
+             gint         width,
+             gint         height)
+{
+    g_autofree gchar *file = NULL;
+    g_autoptr(GError) err = NULL;
+    g_autoptr(GdkPixbuf) pixbuf = NULL;
+    cairo_surface_t *hilight = NULL;
+
+    file = get_hilight_file (map->selected_offset, dim);
+
+    if (g_hash_table_lookup_extended (map->hilights, file, NULL, (gpointer *) &hilight))
+        return hilight;
+
+    pixbuf = load_hilight (file, width, height, map->hilight_scale, &err);
+
+    if (!pixbuf)
     {
         g_warning ("Could not load hilight: %s",
                    (err) ? err->message : "Unknown Error");
     }
     else
     {
-        g_autoptr(GdkPixbuf) hilight = NULL;
+        hilight = cdk_cairo_surface_create_from_pixbuf (pixbuf, map->hilight_scale, NULL);
+    }
+
+    /* a missing highlight is remembered too, so it isn't looked for on every draw */
+    g_hash_table_remove (map->pending_hilights, file);
+    g_hash_table_insert (map->hilights, g_steal_pointer (&file), hilight);
+
+    return hilight;
+}
+
+static gboolean
+cc_timezone_map_draw (CtkWidget *widget,
+                      cairo_t   *cr)
+{
+    TimezoneMap *map = TIMEZONEMAP (widget);
+    cairo_surface_t *hilight;
+    CtkAllocation alloc;
+    gboolean dim;
+    gint scale;
+    gdouble pointx, pointy;
 
-        hilight = gdk_pixbuf_scale_simple (orig_hilight, alloc.width,
-                                           alloc.height, GDK_INTERP_BILINEAR);
-        cdk_cairo_set_source_pixbuf (cr, hilight, 0, 0);
+    ctk_widget_get_allocation (widget, &alloc);
+
+    /* paint background */
+    cdk_cairo_set_source_pixbuf (cr, map->background, 0, 0);
+    cairo_paint (cr);
+
+    /* paint hilight */
+    dim = !ctk_widget_is_sensitive (widget);
+
+    /* the cached highlights are only valid for the scale they were made at */
+    scale = ctk_widget_get_scale_factor (widget);
+    if (scale != map->hilight_scale)
+    {
+        reset_hilights (map);
+        map->hilight_scale = scale;
+    }
+
+    hilight = get_hilight (map, dim, alloc.width, alloc.height);
+    if (hilight)
+    {
+        cairo_set_source_surface (cr, hilight, 0, 0);
 
         cairo_paint (cr);
     }
 
+    prescale_adjacent_hilights (map, dim, alloc.width, alloc.height);
+    prune_hilights (map, dim);
+
     if (map->location)
     {
         pointx = convert_longitude_to_x (map->location->longitude, alloc.width);
@@ -421,18 +837,6 @@ cc_timezone_map_state_flags_changed (CtkWidget     *widget,
     if (CTK_WIDGET_CLASS (timezone_map_parent_class)->state_flags_changed)
         CTK_WIDGET_CLASS (timezone_map_parent_class)->state_flags_changed (widget, prev_state);
 }
-static gint sort_locations (TzLocation *a,
-                            TzLocation *b)
-{
-    if (a->dist > b->dist)
-        return 1;
-
-    if (a->dist < b->dist)
-        return -1;
-
-    return 0;
-}
-
 static void
 set_location (TimezoneMap   *map,
               TzLocation    *location)
@@ -457,11 +861,7 @@ button_press_event (TimezoneMap    *map,
     guchar *pixels;
     gint rowstride;
     guint i;
-
-    const GPtrArray *array;
-    gint width, height;
-    GList *distances = NULL;
-    CtkAllocation alloc;
+    TzLocation *location;
 
     x = event->x;
     y = event->y;
@@ -487,34 +887,9 @@ button_press_event (TimezoneMap    *map,
 
     ctk_widget_queue_draw (CTK_WIDGET (map));
 
-  /* work out the co-ordinates */
-
-    array = tz_get_locations (map->tzdb);
-
-    ctk_widget_get_allocation (CTK_WIDGET (map), &alloc);
-    width = alloc.width;
-    height = alloc.height;
-
-    for (i = 0; i < array->len; i++)
-    {
-        gdouble pointx, pointy, dx, dy;
-        TzLocation *loc = array->pdata[i];
-
-        pointx = convert_longitude_to_x (loc->longitude, width);
-        pointy = convert_latitude_to_y (loc->latitude, height);
-
-        dx = pointx - x;
-        dy = pointy - y;
-
-        loc->dist = dx * dx + dy * dy;
-        distances = g_list_prepend (distances, loc);
-
-    }
-    distances = g_list_sort (distances, (GCompareFunc) sort_locations);
-
-    set_location (map, (TzLocation*) distances->data);
-
-    g_list_free (distances);
+    location = get_nearest_location (map, x, y);
+    if (location)
+        set_location (map, location);
 
     return TRUE;
 }
@@ -585,6 +960,13 @@ timezone_map_init (TimezoneMap *map)
 
     map->tzdb = tz_load_db ();
 
+    map->hilights = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                           g_free, free_hilight);
+    map->pending_hilights = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                   g_free, NULL);
+    map->hilight_cancellable = g_cancellable_new ();
+    map->hilight_scale = 1;
+
     g_signal_connect_object (map,
                             "button-press-event",
                              G_CALLBACK (button_press_event),
@@ -49,9 +49,24 @@ typedef struct TimezoneMap
 
     gdouble selected_offset;
 
+    /* Highlight surfaces for the allocation and scale factor, by file name */
+    GHashTable *hilights;
+    GHashTable *pending_hilights;
+    GCancellable *hilight_cancellable;
+    gint hilight_scale;
+
     TzDB *tzdb;
     TzLocation *location;
 
+    /* The locations projected to the allocation, bucketed by cell for
+     * finding the nearest one to a point
+     */
+    gdouble *city_points;
+    guint *city_cells;
+    guint *city_indices;
+    gint city_cols;
+    gint city_rows;
+
     gchar *bubble_text;
 }TimezoneMap;
 
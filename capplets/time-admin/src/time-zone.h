@@ -49,8 +49,6 @@ typedef struct TzLocation
     gdouble longitude;
     gchar *zone;
     gchar *comment;
-
-    gdouble dist; /* distance to clicked point for comparison */
 }TzLocation;
 
 typedef struct TzInfo
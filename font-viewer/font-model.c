@@ -45,7 +45,16 @@
 struct _FontViewModelPrivate {
     /* list of fonts in fontconfig database */
     FcFontSet *font_list;
-    GMutex font_list_mutex;
+
+    /* "path#index" -> FontRow showing that face */
+    GHashTable *rows;
+    guint next_row_serial;
+
+    /* the rows by collation key, in the order they have in the store */
+    GSequence *order;
+
+    /* whether config-changed was emitted for a complete font list yet */
+    gboolean loaded;
 
     FT_Library library;
 
@@ -129,6 +138,14 @@ font_view_model_get_iter_for_face (FontViewModel *self,
     return found;
 }
 
+typedef struct {
+    CtkTreeIter iter;
+    /* tells apart the rows of a face that was removed and added again */
+    guint serial;
+    gchar *collation_key;
+    GSequenceIter *order_iter;
+} FontRow;
+
 typedef struct {
     FontViewModel *self;
     GFile *font_file;
@@ -136,9 +153,38 @@ typedef struct {
     gint face_index;
     gchar *uri;
     GdkPixbuf *pixbuf;
-    CtkTreeIter iter;
+    gchar *key;
+    guint row_serial;
 } ThumbInfoData;
 
+static void
+font_row_free (gpointer user_data)
+{
+    FontRow *row = user_data;
+
+    g_sequence_remove (row->order_iter);
+    g_free (row->collation_key);
+    g_slice_free (FontRow, row);
+}
+
+static gint
+font_row_compare (gconstpointer a,
+                  gconstpointer b,
+                  gpointer user_data)
+{
+    const FontRow *row_a = a;
+    const FontRow *row_b = b;
+
+    return strcmp (row_a->collation_key, row_b->collation_key);
+}
+
+static gchar *
+font_view_model_face_key (const gchar *font_path,
+                          gint face_index)
+{
+    return g_strdup_printf ("%s#%d", font_path, face_index);
+}
+
 static void
 thumb_info_data_free (gpointer user_data)
 {
@@ -149,6 +195,7 @@ thumb_info_data_free (gpointer user_data)
     g_clear_object (&thumb_info->pixbuf);
     g_free (thumb_info->font_path);
     g_free (thumb_info->uri);
+    g_free (thumb_info->key);
 
     g_slice_free (ThumbInfoData, thumb_info);
 }
@@ -157,9 +204,16 @@ static gboolean
 one_thumbnail_done (gpointer user_data)
 {
     ThumbInfoData *thumb_info = user_data;
+    FontRow *row;
+
+    /* the row may have gone away, or been replaced by a new row for
+     * the same face, while the thumbnail was being loaded
+     */
+    row = g_hash_table_lookup (thumb_info->self->priv->rows, thumb_info->key);
 
-    if (thumb_info->pixbuf != NULL)
-        ctk_list_store_set (CTK_LIST_STORE (thumb_info->self), &(thumb_info->iter),
+    if (thumb_info->pixbuf != NULL && row != NULL &&
+        row->serial == thumb_info->row_serial)
+        ctk_list_store_set (CTK_LIST_STORE (thumb_info->self), &row->iter,
                             COLUMN_ICON, thumb_info->pixbuf,
                             -1);
 
@@ -316,6 +370,8 @@ typedef struct {
     gchar *font_path;
     gint face_index;
     gchar *font_name;
+    gchar *collation_key;
+    gchar *search_key;
 } FontInfoData;
 
 static void
@@ -325,105 +381,172 @@ font_info_data_free (gpointer user_data)
 
     g_free (font_info->font_path);
     g_free (font_info->font_name);
+    g_free (font_info->collation_key);
+    g_free (font_info->search_key);
     g_slice_free (FontInfoData, font_info);
 }
 
+static void
+font_view_model_start_thumbnails (GList *thumb_infos)
+{
+    GTask *task;
+
+    if (thumb_infos == NULL)
+        return;
+
+    task = g_task_new (NULL, NULL, NULL, NULL);
+    g_task_set_task_data (task, thumb_infos, NULL);
+    g_task_run_in_thread (task, ensure_thumbnails_job);
+    g_object_unref (task);
+}
+
 static void
 font_infos_loaded (GObject *source_object,
                    GAsyncResult *result,
                    gpointer user_data)
 {
     FontViewModel *self = FONT_VIEW_MODEL (source_object);
-    GTask *task = NULL;
-    GList *l, *thumb_infos = NULL;
-    GList *font_infos = g_task_propagate_pointer (G_TASK (result), NULL);
-
-    for (l = font_infos; l != NULL; l = l->next) {
-        FontInfoData *font_info = l->data;
-        gchar *collation_key;
-        CtkTreeIter iter;
+    GList *thumb_infos = NULL;
+    GPtrArray *font_infos;
+    guint i;
+
+    if (!g_task_propagate_boolean (G_TASK (result), NULL))
+        return;
+
+    font_infos = g_task_get_task_data (G_TASK (result));
+
+    /* the store itself isn't sortable: the batch comes sorted by
+     * collation key from the thread, and every row goes straight to its
+     * place as found in the order index, so no row ever has its column
+     * values copied out to be compared. Into an empty store, as on the
+     * initial load, that is a plain append.
+     */
+    for (i = 0; i < font_infos->len; i++) {
+        FontInfoData *font_info = g_ptr_array_index (font_infos, i);
+        gchar *key;
+        FontRow *row;
         ThumbInfoData *thumb_info;
+        gint position;
 
-        collation_key = g_utf8_collate_key (font_info->font_name, -1);
-        ctk_list_store_insert_with_values (CTK_LIST_STORE (self), &iter, -1,
+        if (font_info->font_name == NULL)
+            continue;
+
+        key = font_view_model_face_key (font_info->font_path, font_info->face_index);
+        if (g_hash_table_contains (self->priv->rows, key)) {
+            g_free (key);
+            continue;
+        }
+
+        row = g_slice_new (FontRow);
+        row->serial = self->priv->next_row_serial++;
+        row->collation_key = g_strdup (font_info->collation_key);
+        row->order_iter = g_sequence_insert_sorted (self->priv->order, row,
+                                                    font_row_compare, NULL);
+        position = g_sequence_iter_get_position (row->order_iter);
+
+        ctk_list_store_insert_with_values (CTK_LIST_STORE (self), &row->iter, position,
                                            COLUMN_NAME, font_info->font_name,
                                            COLUMN_PATH, font_info->font_path,
                                            COLUMN_FACE_INDEX, font_info->face_index,
                                            COLUMN_ICON, self->priv->fallback_icon,
-                                           COLUMN_COLLATION_KEY, collation_key,
+                                           COLUMN_COLLATION_KEY, font_info->collation_key,
+                                           COLUMN_SEARCH_KEY, font_info->search_key,
                                            -1);
-        g_free (collation_key);
 
         thumb_info = g_slice_new0 (ThumbInfoData);
         thumb_info->font_file = g_file_new_for_path (font_info->font_path);
         thumb_info->face_index = font_info->face_index;
-        thumb_info->iter = iter;
+        thumb_info->key = g_strdup (key);
+        thumb_info->row_serial = row->serial;
         thumb_info->self = g_object_ref (self);
 
-        font_info_data_free (font_info);
+        g_hash_table_insert (self->priv->rows, key, row);
         thumb_infos = g_list_prepend (thumb_infos, thumb_info);
     }
 
+    self->priv->loaded = TRUE;
     g_signal_emit (self, signals[CONFIG_CHANGED], 0);
-    g_list_free (font_infos);
 
-    task = g_task_new (NULL, NULL, NULL, NULL);
-    g_task_set_task_data (task, thumb_infos, NULL);
-    g_task_run_in_thread (task, ensure_thumbnails_job);
-    g_object_unref (task);
+    font_view_model_start_thumbnails (thumb_infos);
+}
+
+static gint
+font_info_compare (gconstpointer a,
+                   gconstpointer b)
+{
+    const FontInfoData *info_a = *(FontInfoData **) a;
+    const FontInfoData *info_b = *(FontInfoData **) b;
+
+    return g_strcmp0 (info_a->collation_key, info_b->collation_key);
 }
 
 static void
 load_font_infos (GTask *task,
                  gpointer source_object,
-                 gpointer user_data,
+                 gpointer task_data,
                  GCancellable *cancellable)
 {
     FontViewModel *self = FONT_VIEW_MODEL (source_object);
-    gint i, n_fonts;
-    GList *font_infos = NULL;
-
-    n_fonts = self->priv->font_list->nfont;
+    GPtrArray *font_infos = task_data;
+    guint i;
 
-    for (i = 0; i < n_fonts; i++) {
-        FontInfoData *font_info;
-        FcChar8 *file;
-        int index;
-        gchar *font_name;
+    for (i = 0; i < font_infos->len; i++) {
+        FontInfoData *font_info = g_ptr_array_index (font_infos, i);
 
         if (g_cancellable_is_cancelled (cancellable))
             break;
 
-        g_mutex_lock (&self->priv->font_list_mutex);
-        FcPatternGetString (self->priv->font_list->fonts[i], FC_FILE, 0, &file);
-        FcPatternGetInteger (self->priv->font_list->fonts[i], FC_INDEX, 0, &index);
-        g_mutex_unlock (&self->priv->font_list_mutex);
+        font_info->font_name = font_utils_get_font_name_for_file (self->priv->library,
+                                                                  font_info->font_path,
+                                                                  font_info->face_index);
+        if (font_info->font_name == NULL)
+            continue;
 
-        font_name = font_utils_get_font_name_for_file (self->priv->library,
-                                                       (const gchar *) file,
-                                                       index);
+        font_info->collation_key = g_utf8_collate_key (font_info->font_name, -1);
+        font_info->search_key = font_utils_get_search_key (font_info->font_name);
+    }
 
-        if (!font_name)
-            continue;
+    g_ptr_array_sort (font_infos, font_info_compare);
 
-        font_info = g_slice_new0 (FontInfoData);
-        font_info->font_name = font_name;
-        font_info->font_path = g_strdup ((const gchar *) file);
-        font_info->face_index = index;
+    g_task_return_boolean (task, TRUE);
+}
+
+/* drop the rows whose face no longer is in the font list */
+static gboolean
+remove_stale_rows (FontViewModel *self,
+                   GHashTable *current_keys)
+{
+    GHashTableIter hiter;
+    gpointer key, value;
+    gboolean removed = FALSE;
+
+    g_hash_table_iter_init (&hiter, self->priv->rows);
+    while (g_hash_table_iter_next (&hiter, &key, &value)) {
+        if (g_hash_table_contains (current_keys, key))
+            continue;
 
-        font_infos = g_list_prepend (font_infos, font_info);
+        ctk_list_store_remove (CTK_LIST_STORE (self), &((FontRow *) value)->iter);
+        g_hash_table_iter_remove (&hiter);
+        removed = TRUE;
     }
 
-    g_task_return_pointer (task, font_infos, NULL);
+    return removed;
 }
 
-/* make sure the font list is valid */
+/* make sure the font list is valid, only touching the rows of the
+ * faces that were added or removed since the last time.
+ */
 static void
 ensure_font_list (FontViewModel *self)
 {
     FcPattern *pat;
     FcObjectSet *os;
+    FcFontSet *font_list;
+    GHashTable *current_keys;
+    GPtrArray *font_infos;
     GTask *task;
+    gboolean removed;
+    gint i;
 
     /* always reinitialize the font database */
     if (!FcInitReinitialize())
@@ -434,33 +557,70 @@ ensure_font_list (FontViewModel *self)
         g_clear_object (&self->priv->cancellable);
     }
 
-    ctk_list_store_clear (CTK_LIST_STORE (self));
-
     pat = FcPatternCreate ();
     os = FcObjectSetBuild (FC_FILE, FC_INDEX, FC_FAMILY, FC_WEIGHT, FC_SLANT, NULL);
 
-    g_mutex_lock (&self->priv->font_list_mutex);
+    font_list = FcFontList (NULL, pat, os);
 
-    if (self->priv->font_list) {
+    FcPatternDestroy (pat);
+    FcObjectSetDestroy (os);
+
+    if (!font_list)
+        return;
+
+    if (self->priv->font_list)
         FcFontSetDestroy (self->priv->font_list);
-        self->priv->font_list = NULL;
+    self->priv->font_list = font_list;
+
+    current_keys = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    font_infos = g_ptr_array_new_with_free_func (font_info_data_free);
+
+    for (i = 0; i < font_list->nfont; i++) {
+        FontInfoData *font_info;
+        FcChar8 *file;
+        int index;
+        gchar *key;
+
+        if (FcPatternGetString (font_list->fonts[i], FC_FILE, 0, &file) != FcResultMatch)
+            continue;
+        if (FcPatternGetInteger (font_list->fonts[i], FC_INDEX, 0, &index) != FcResultMatch)
+            index = 0;
+
+        key = font_view_model_face_key ((const gchar *) file, index);
+        if (!g_hash_table_add (current_keys, key))
+            continue;
+
+        if (g_hash_table_contains (self->priv->rows, key))
+            continue;
+
+        font_info = g_slice_new0 (FontInfoData);
+        font_info->font_path = g_strdup ((const gchar *) file);
+        font_info->face_index = index;
+        g_ptr_array_add (font_infos, font_info);
     }
 
-    self->priv->font_list = FcFontList (NULL, pat, os);
+    removed = remove_stale_rows (self, current_keys);
+    g_hash_table_destroy (current_keys);
 
-    g_mutex_unlock (&self->priv->font_list_mutex);
+    if (font_infos->len == 0) {
+        g_ptr_array_unref (font_infos);
 
-    FcPatternDestroy (pat);
-    FcObjectSetDestroy (os);
+        /* the views wait for the first complete list, even an empty one */
+        if (removed || !self->priv->loaded) {
+            self->priv->loaded = TRUE;
+            g_signal_emit (self, signals[CONFIG_CHANGED], 0);
+        }
 
-    if (!self->priv->font_list)
         return;
+    }
 
     self->priv->cancellable = g_cancellable_new ();
 
     task = g_task_new (self, self->priv->cancellable, font_infos_loaded, NULL);
+    g_task_set_task_data (task, font_infos, (GDestroyNotify) g_ptr_array_unref);
     g_task_set_return_on_cancel (task, TRUE);
     g_task_run_in_thread (task, load_font_infos);
+    g_object_unref (task);
 }
 
 static gboolean
@@ -472,28 +632,31 @@ ensure_font_list_idle (gpointer user_data)
     return FALSE;
 }
 
-static int
-font_view_model_sort_func (CtkTreeModel *model,
-                           CtkTreeIter *a,
-                           CtkTreeIter *b,
-                           gpointer user_data)
+static void
+forget_rows_for_file (FontViewModel *self,
+                      GFile *file)
 {
-    gchar *key_a = NULL, *key_b = NULL;
-    int retval;
+    GHashTableIter hiter;
+    gpointer key, value;
+    gchar *path, *prefix;
 
-    ctk_tree_model_get (model, a,
-                        COLUMN_COLLATION_KEY, &key_a,
-                        -1);
-    ctk_tree_model_get (model, b,
-                        COLUMN_COLLATION_KEY, &key_b,
-                        -1);
+    path = g_file_get_path (file);
+    if (path == NULL)
+        return;
 
-    retval = g_strcmp0 (key_a, key_b);
+    prefix = g_strconcat (path, "#", NULL);
 
-    g_free (key_a);
-    g_free (key_b);
+    g_hash_table_iter_init (&hiter, self->priv->rows);
+    while (g_hash_table_iter_next (&hiter, &key, &value)) {
+        if (!g_str_has_prefix (key, prefix))
+            continue;
 
-    return retval;
+        ctk_list_store_remove (CTK_LIST_STORE (self), &((FontRow *) value)->iter);
+        g_hash_table_iter_remove (&hiter);
+    }
+
+    g_free (prefix);
+    g_free (path);
 }
 
 static void
@@ -505,6 +668,12 @@ file_monitor_changed_cb (GFileMonitor *monitor,
 {
     FontViewModel *self = user_data;
 
+    /* a font file rewritten in place keeps its key, so forget its rows
+     * to have them reloaded with the new contents.
+     */
+    if (event == G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT)
+        forget_rows_for_file (self, file);
+
     if (event == G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT ||
         event == G_FILE_MONITOR_EVENT_DELETED ||
         event == G_FILE_MONITOR_EVENT_CREATED)
@@ -567,26 +736,21 @@ static void
 font_view_model_init (FontViewModel *self)
 {
     GType types[NUM_COLUMNS] =
-        { G_TYPE_STRING, G_TYPE_STRING, G_TYPE_INT, GDK_TYPE_PIXBUF, G_TYPE_STRING };
+        { G_TYPE_STRING, G_TYPE_STRING, G_TYPE_INT, GDK_TYPE_PIXBUF, G_TYPE_STRING,
+          G_TYPE_STRING };
 
     self->priv = font_view_model_get_instance_private (self);
 
     if (FT_Init_FreeType (&self->priv->library) != FT_Err_Ok)
         g_critical ("Can't initialize FreeType library");
 
-    g_mutex_init (&self->priv->font_list_mutex);
+    self->priv->order = g_sequence_new (NULL);
+    self->priv->rows = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                              g_free, font_row_free);
 
     ctk_list_store_set_column_types (CTK_LIST_STORE (self),
                                      NUM_COLUMNS, types);
 
-    ctk_tree_sortable_set_sort_column_id (CTK_TREE_SORTABLE (self),
-                                          COLUMN_NAME,
-                                          CTK_SORT_ASCENDING);
-    ctk_tree_sortable_set_sort_func (CTK_TREE_SORTABLE (self),
-                                     COLUMN_NAME,
-                                     font_view_model_sort_func,
-                                     NULL, NULL);
-
 
     self->priv->fallback_icon = get_fallback_icon ();
 
@@ -614,7 +778,8 @@ font_view_model_finalize (GObject *obj)
         self->priv->library = NULL;
     }
 
-    g_mutex_clear (&self->priv->font_list_mutex);
+    g_clear_pointer (&self->priv->rows, g_hash_table_destroy);
+    g_clear_pointer (&self->priv->order, g_sequence_free);
     g_clear_object (&self->priv->fallback_icon);
     g_list_free_full (self->priv->monitors, (GDestroyNotify) g_object_unref);
 
@@ -36,6 +36,7 @@ typedef enum {
   COLUMN_FACE_INDEX,
   COLUMN_ICON,
   COLUMN_COLLATION_KEY,
+  COLUMN_SEARCH_KEY,
   NUM_COLUMNS
 } FontViewModelColumns;
 
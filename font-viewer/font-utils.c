@@ -65,3 +65,20 @@ font_utils_get_font_name_for_file (FT_Library library,
     return name;
 }
 
+/* Normalized, casefolded form of @str, to be matched with strstr() */
+gchar *
+font_utils_get_search_key (const gchar *str)
+{
+    gchar *casefolded, *key;
+
+    casefolded = g_utf8_casefold (str, -1);
+    key = g_utf8_normalize (casefolded, -1, G_NORMALIZE_ALL);
+
+    if (key == NULL)
+        return casefolded;
+
+    g_free (casefolded);
+
+    return key;
+}
+
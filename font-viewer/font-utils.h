@@ -29,6 +29,7 @@ gchar * font_utils_get_font_name (FT_Face face);
 gchar * font_utils_get_font_name_for_file (FT_Library library,
                                            const gchar *path,
                                            gint face_index);
+gchar * font_utils_get_search_key (const gchar *str);
 
 #endif /* __FONT_UTILS_H__ */
 
@@ -37,6 +37,7 @@
 #include <glib/gi18n.h>
 
 #include "font-model.h"
+#include "font-utils.h"
 #include "gd-main-toolbar.h"
 #include "sushi-font-widget.h"
 
@@ -67,6 +68,7 @@ typedef struct {
 
     CtkTreeModel *model;
     CtkTreeModel *filter_model;
+    gchar *search_key;
 
     GFile *font_file;
 } FontViewApplication;
@@ -319,12 +321,32 @@ font_install_finished_cb (GObject      *source_object,
     }
 }
 
+static gboolean font_visible_func (CtkTreeModel *model,
+                                   CtkTreeIter  *iter,
+                                   gpointer      data);
+
+static void
+font_view_attach_model (FontViewApplication *self)
+{
+    self->filter_model = ctk_tree_model_filter_new (self->model, NULL);
+    ctk_tree_model_filter_set_visible_func (CTK_TREE_MODEL_FILTER (self->filter_model),
+                                            font_visible_func, self, NULL);
+
+    if (self->icon_view != NULL)
+        ctk_icon_view_set_model (CTK_ICON_VIEW (self->icon_view), self->filter_model);
+}
+
 static void
 font_model_config_changed_cb (FontViewModel *model,
                               gpointer user_data)
 {
     FontViewApplication *self = user_data;
 
+    /* the initial list is built with nothing watching the store, and
+     * shown in one go once complete, rather than laid out row by row */
+    if (self->filter_model == NULL)
+        font_view_attach_model (self);
+
     if (self->font_file != NULL)
         install_button_refresh_appearance (self, NULL);
 }
@@ -509,28 +531,23 @@ font_visible_func (CtkTreeModel *model,
 {
   FontViewApplication *self = data;
   gboolean ret;
-  const char *search;
-  char *name;
-  char *cf_name;
-  char *cf_search;
+  GValue value = G_VALUE_INIT;
+  const char *search_key;
 
   if (!ctk_toggle_button_get_active (CTK_TOGGLE_BUTTON (self->search_button)))
     return TRUE;
 
-  search = ctk_entry_get_text (CTK_ENTRY (self->entry));
-
-  ctk_tree_model_get (model, iter,
-                      COLUMN_NAME, &name,
-                      -1);
+  /* the query is casefolded once per change, and every row carries
+   * its own key, so there is nothing to fold here */
+  if (self->search_key == NULL || self->search_key[0] == '\0')
+    return TRUE;
 
-  cf_name = g_utf8_casefold (name, -1);
-  cf_search = g_utf8_casefold (search, -1);
+  ctk_tree_model_get_value (model, iter, COLUMN_SEARCH_KEY, &value);
+  search_key = g_value_get_string (&value);
 
-  ret = strstr (cf_name, cf_search) != NULL;
+  ret = search_key != NULL && strstr (search_key, self->search_key) != NULL;
 
-  g_free (name);
-  g_free (cf_name);
-  g_free (cf_search);
+  g_value_unset (&value);
 
   return ret;
 }
@@ -544,9 +561,6 @@ font_view_ensure_model (FontViewApplication *self)
     self->model = font_view_model_new ();
     g_signal_connect (self->model, "config-changed",
                       G_CALLBACK (font_model_config_changed_cb), self);
-    self->filter_model = ctk_tree_model_filter_new (self->model, NULL);
-    ctk_tree_model_filter_set_visible_func (CTK_TREE_MODEL_FILTER (self->filter_model),
-                                            font_visible_func, self, NULL);
 }
 
 static void
@@ -799,7 +813,13 @@ static void
 search_text_changed (CtkEntry *entry,
                      FontViewApplication *self)
 {
-  ctk_tree_model_filter_refilter (CTK_TREE_MODEL_FILTER (self->filter_model));
+  /* "search-changed" is already delayed by CtkSearchEntry, so this
+   * only runs once the user pauses typing */
+  g_free (self->search_key);
+  self->search_key = font_utils_get_search_key (ctk_entry_get_text (entry));
+
+  if (self->filter_model != NULL)
+    ctk_tree_model_filter_refilter (CTK_TREE_MODEL_FILTER (self->filter_model));
 }
 
 static void
@@ -902,6 +922,7 @@ font_view_application_dispose (GObject *obj)
 
     g_clear_object (&self->model);
     g_clear_object (&self->filter_model);
+    g_clear_pointer (&self->search_key, g_free);
 
     G_OBJECT_CLASS (font_view_application_parent_class)->dispose (obj);
 }
@@ -57,8 +57,21 @@ struct _SushiFontWidgetPrivate {
   gchar *sample_string;
 
   gchar *font_name;
+
+  /* rendered text lines, valid for the size and scale below */
+  GPtrArray *lines;
+  gint lines_width;
+  gint lines_height;
+  gint lines_scale;
 };
 
+typedef struct {
+  /* alpha-only, so the current text color is applied when drawing */
+  cairo_surface_t *mask;
+  gint y;
+  gint height;
+} CachedLine;
+
 static GParamSpec *properties[NUM_PROPERTIES] = { NULL, };
 static guint signals[NUM_SIGNALS] = { 0, };
 
@@ -72,6 +85,21 @@ static const gchar lowercase_text_stock[] = "abcdefghijklmnopqrstuvwxyz";
 static const gchar uppercase_text_stock[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
 static const gchar punctuation_text_stock[] = "0123456789.:,;(*!?')";
 
+static void
+cached_line_free (gpointer data)
+{
+  CachedLine *line = data;
+
+  cairo_surface_destroy (line->mask);
+  g_slice_free (CachedLine, line);
+}
+
+static void
+sushi_font_widget_clear_lines (SushiFontWidget *self)
+{
+  g_clear_pointer (&self->priv->lines, g_ptr_array_unref);
+}
+
 /* adapted from gnome-utils:font-viewer/font-view.c
  *
  * Copyright (C) 2002-2003  James Henstridge <james@daa.com.au>
@@ -80,34 +108,66 @@ static const gchar punctuation_text_stock[] = "0123456789.:,;(*!?')";
  * License: GPLv2+
  */
 static void
-draw_string (SushiFontWidget *self,
-             cairo_t *cr,
-             CtkBorder padding,
-	     const gchar *text,
-	     gint *pos_y)
+cache_string (SushiFontWidget *self,
+              cairo_t *measure_cr,
+              CtkBorder padding,
+              const gchar *text,
+              gint *pos_y)
 {
+  SushiFontWidgetPrivate *priv = self->priv;
   cairo_font_extents_t font_extents;
   cairo_text_extents_t extents;
+  cairo_font_options_t *options;
+  cairo_matrix_t font_matrix;
   CtkTextDirection text_dir;
-  gint pos_x;
+  CachedLine *line;
+  cairo_t *cr;
+  gint pos_x, top, bottom;
 
   text_dir = ctk_widget_get_direction (CTK_WIDGET (self));
 
-  cairo_font_extents (cr, &font_extents);
-  cairo_text_extents (cr, text, &extents);
+  cairo_font_extents (measure_cr, &font_extents);
+  cairo_text_extents (measure_cr, text, &extents);
 
-  if (pos_y != NULL)
-    *pos_y += font_extents.ascent + font_extents.descent +
-      extents.y_advance + LINE_SPACING / 2;
+  top = *pos_y;
+  *pos_y += font_extents.ascent + font_extents.descent +
+    extents.y_advance + LINE_SPACING / 2;
   if (text_dir == CTK_TEXT_DIR_LTR)
     pos_x = padding.left;
   else {
-    pos_x = ctk_widget_get_allocated_width (CTK_WIDGET (self)) -
-      extents.x_advance - padding.right;
+    pos_x = priv->lines_width - extents.x_advance - padding.right;
   }
 
-  cairo_move_to (cr, pos_x, *pos_y);
+  /* the ink can reach past the line box, e.g. with descenders */
+  top = MIN (top, *pos_y + (gint) floor (extents.y_bearing));
+  bottom = *pos_y + (gint) ceil (MAX (font_extents.descent,
+                                      extents.y_bearing + extents.height));
+  bottom = MAX (bottom, *pos_y + LINE_SPACING / 2);
+
+  line = g_slice_new0 (CachedLine);
+  line->y = top;
+  line->height = MAX (bottom - top, 1);
+  line->mask = cairo_image_surface_create (CAIRO_FORMAT_A8,
+                                           priv->lines_width * priv->lines_scale,
+                                           line->height * priv->lines_scale);
+  cairo_surface_set_device_scale (line->mask, priv->lines_scale, priv->lines_scale);
+
+  cr = cairo_create (line->mask);
+
+  options = cairo_font_options_create ();
+  cairo_get_font_options (measure_cr, options);
+  cairo_set_font_options (cr, options);
+  cairo_font_options_destroy (options);
+
+  cairo_get_font_matrix (measure_cr, &font_matrix);
+  cairo_set_font_face (cr, cairo_get_font_face (measure_cr));
+  cairo_set_font_matrix (cr, &font_matrix);
+
+  cairo_move_to (cr, pos_x, *pos_y - top);
   cairo_show_text (cr, text);
+  cairo_destroy (cr);
+
+  g_ptr_array_add (priv->lines, line);
 
   *pos_y += LINE_SPACING / 2;
 }
@@ -147,57 +207,55 @@ check_font_contain_text (FT_Face face,
   return retval;
 }
 
-static gchar *
+/* the random sample is picked among the first characters of the face,
+ * there is no need to walk the charmap of fonts with huge coverage */
+#define MAX_SAMPLE_CHARS 1024
+
+static gunichar *
 build_charlist_for_face (FT_Face face,
                          gint *length)
 {
-  GString *string;
+  gunichar *chars;
   gulong c;
   guint glyph;
   gint total_chars = 0;
 
-  string = g_string_new (NULL);
+  chars = g_new (gunichar, MAX_SAMPLE_CHARS);
 
   c = FT_Get_First_Char (face, &glyph);
 
-  while (glyph != 0) {
-    g_string_append_unichar (string, (gunichar) c);
+  while (glyph != 0 && total_chars < MAX_SAMPLE_CHARS) {
+    chars[total_chars++] = (gunichar) c;
     c = FT_Get_Next_Char (face, c, &glyph);
-    total_chars++;
   }
 
   if (length)
     *length = total_chars;
 
-  return g_string_free (string, FALSE);
+  return chars;
 }
 
 static gchar *
 random_string_from_available_chars (FT_Face face,
                                     gint n_chars)
 {
-  gchar *chars;
-  gint idx, rand, total_chars;
+  gunichar *chars;
+  gint idx, total_chars;
   GString *retval;
-  gchar *ptr, *end;
 
-  idx = 0;
   chars = build_charlist_for_face (face, &total_chars);
 
-  if (total_chars == 0)
+  if (total_chars == 0) {
+    g_free (chars);
     return NULL;
+  }
 
-  retval = g_string_new (NULL);
-
-  while (idx < n_chars) {
-    rand = g_random_int_range (0, total_chars);
+  retval = g_string_sized_new (n_chars * 4);
 
-    ptr = g_utf8_offset_to_pointer (chars, rand);
-    end = g_utf8_find_next_char (ptr, NULL);
+  for (idx = 0; idx < n_chars; idx++)
+    g_string_append_unichar (retval, chars[g_random_int_range (0, total_chars)]);
 
-    g_string_append_len (retval, ptr, end - ptr);
-    idx++;
-  }
+  g_free (chars);
 
   return g_string_free (retval, FALSE);
 }
@@ -463,49 +521,62 @@ sushi_font_widget_get_preferred_height (CtkWidget *drawing_area,
   *natural_height = height;
 }
 
-static gboolean
-sushi_font_widget_draw (CtkWidget *drawing_area,
-                        cairo_t *cr)
+/* Render the text lines once for the current allocation and scale;
+ * redraws only blit them.
+ */
+static void
+sushi_font_widget_ensure_lines (SushiFontWidget *self)
 {
-  SushiFontWidget *self = SUSHI_FONT_WIDGET (drawing_area);
+  CtkWidget *widget = CTK_WIDGET (self);
   SushiFontWidgetPrivate *priv = self->priv;
   gint *sizes = NULL, n_sizes, alpha_size, title_size, pos_y = 0, i;
+  gint allocated_width, allocated_height, scale;
+  const cairo_font_options_t *options;
   cairo_font_face_t *font;
-  FT_Face face = priv->face;
+  cairo_surface_t *surface;
+  cairo_t *cr;
   CtkStyleContext *context;
-  CdkRGBA color;
   CtkBorder padding;
   CtkStateFlags state;
-  gint allocated_width, allocated_height;
 
-  if (face == NULL)
-    goto end;
+  allocated_width = ctk_widget_get_allocated_width (widget);
+  allocated_height = ctk_widget_get_allocated_height (widget);
+  scale = ctk_widget_get_scale_factor (widget);
 
-  context = ctk_widget_get_style_context (drawing_area);
-  state = ctk_style_context_get_state (context);
+  if (priv->lines != NULL &&
+      priv->lines_width == allocated_width &&
+      priv->lines_height == allocated_height &&
+      priv->lines_scale == scale)
+    return;
 
-  allocated_width = ctk_widget_get_allocated_width (drawing_area);
-  allocated_height = ctk_widget_get_allocated_height (drawing_area);
+  sushi_font_widget_clear_lines (self);
 
-  ctk_render_background (context, cr,
-                         0, 0, allocated_width, allocated_height);
+  priv->lines = g_ptr_array_new_with_free_func (cached_line_free);
+  priv->lines_width = MAX (allocated_width, 1);
+  priv->lines_height = allocated_height;
+  priv->lines_scale = scale;
 
-  ctk_style_context_get_color (context, state, &color);
+  context = ctk_widget_get_style_context (widget);
+  state = ctk_style_context_get_state (context);
   ctk_style_context_get_padding (context, state, &padding);
 
-  cdk_cairo_set_source_rgba (cr, &color);
+  surface = cairo_image_surface_create (CAIRO_FORMAT_A8,
+                                        SURFACE_SIZE, SURFACE_SIZE);
+  cr = cairo_create (surface);
 
-  sizes = build_sizes_table (face, &n_sizes, &alpha_size, &title_size);
+  options = cdk_screen_get_font_options (ctk_widget_get_screen (widget));
+  if (options != NULL)
+    cairo_set_font_options (cr, options);
 
-  font = cairo_ft_font_face_create_for_ft_face (face, 0);
+  sizes = build_sizes_table (priv->face, &n_sizes, &alpha_size, &title_size);
+
+  font = cairo_ft_font_face_create_for_ft_face (priv->face, 0);
   cairo_set_font_face (cr, font);
   cairo_font_face_destroy (font);
 
-  /* draw text */
-
   if (self->priv->font_name != NULL) {
     cairo_set_font_size (cr, title_size);
-    draw_string (self, cr, padding, self->priv->font_name, &pos_y);
+    cache_string (self, cr, padding, self->priv->font_name, &pos_y);
   }
 
   if (pos_y > allocated_height)
@@ -515,17 +586,17 @@ sushi_font_widget_draw (CtkWidget *drawing_area,
   cairo_set_font_size (cr, alpha_size);
 
   if (self->priv->lowercase_text != NULL)
-    draw_string (self, cr, padding, self->priv->lowercase_text, &pos_y);
+    cache_string (self, cr, padding, self->priv->lowercase_text, &pos_y);
   if (pos_y > allocated_height)
     goto end;
 
   if (self->priv->uppercase_text != NULL)
-    draw_string (self, cr, padding, self->priv->uppercase_text, &pos_y);
+    cache_string (self, cr, padding, self->priv->uppercase_text, &pos_y);
   if (pos_y > allocated_height)
     goto end;
 
   if (self->priv->punctuation_text != NULL)
-    draw_string (self, cr, padding, self->priv->punctuation_text, &pos_y);
+    cache_string (self, cr, padding, self->priv->punctuation_text, &pos_y);
   if (pos_y > allocated_height)
     goto end;
 
@@ -533,17 +604,77 @@ sushi_font_widget_draw (CtkWidget *drawing_area,
 
   for (i = 0; i < n_sizes; i++) {
     cairo_set_font_size (cr, sizes[i]);
-    draw_string (self, cr, padding, self->priv->sample_string, &pos_y);
+    cache_string (self, cr, padding, self->priv->sample_string, &pos_y);
     if (pos_y > allocated_height)
       break;
   }
 
  end:
+  cairo_destroy (cr);
+  cairo_surface_destroy (surface);
   g_free (sizes);
+}
+
+static gboolean
+sushi_font_widget_draw (CtkWidget *drawing_area,
+                        cairo_t *cr)
+{
+  SushiFontWidget *self = SUSHI_FONT_WIDGET (drawing_area);
+  SushiFontWidgetPrivate *priv = self->priv;
+  CtkStyleContext *context;
+  CdkRectangle clip;
+  CdkRGBA color;
+  CtkStateFlags state;
+  guint i;
+
+  if (priv->face == NULL)
+    return FALSE;
+
+  context = ctk_widget_get_style_context (drawing_area);
+  state = ctk_style_context_get_state (context);
+
+  ctk_render_background (context, cr, 0, 0,
+                         ctk_widget_get_allocated_width (drawing_area),
+                         ctk_widget_get_allocated_height (drawing_area));
+
+  if (!cdk_cairo_get_clip_rectangle (cr, &clip))
+    return FALSE;
+
+  sushi_font_widget_ensure_lines (self);
+
+  ctk_style_context_get_color (context, state, &color);
+  cdk_cairo_set_source_rgba (cr, &color);
+
+  for (i = 0; i < priv->lines->len; i++) {
+    CachedLine *line = g_ptr_array_index (priv->lines, i);
+
+    if (line->y + line->height <= clip.y ||
+        line->y >= clip.y + clip.height)
+      continue;
+
+    cairo_mask_surface (cr, line->mask, 0, line->y);
+  }
 
   return FALSE;
 }
 
+static void
+sushi_font_widget_style_updated (CtkWidget *widget)
+{
+  sushi_font_widget_clear_lines (SUSHI_FONT_WIDGET (widget));
+
+  CTK_WIDGET_CLASS (sushi_font_widget_parent_class)->style_updated (widget);
+}
+
+static void
+sushi_font_widget_direction_changed (CtkWidget *widget,
+                                     CtkTextDirection previous_direction)
+{
+  sushi_font_widget_clear_lines (SUSHI_FONT_WIDGET (widget));
+
+  CTK_WIDGET_CLASS (sushi_font_widget_parent_class)->direction_changed (widget, previous_direction);
+}
+
 static void
 font_face_async_ready_cb (GObject *object,
                           GAsyncResult *result,
@@ -566,6 +697,7 @@ font_face_async_ready_cb (GObject *object,
   }
 
   build_strings_for_face (self);
+  sushi_font_widget_clear_lines (self);
 
   ctk_widget_queue_resize (CTK_WIDGET (self));
   g_signal_emit (self, signals[LOADED], 0);
@@ -646,6 +778,7 @@ sushi_font_widget_finalize (GObject *object)
   SushiFontWidget *self = SUSHI_FONT_WIDGET (object);
 
   g_free (self->priv->uri);
+  sushi_font_widget_clear_lines (self);
 
   if (self->priv->face != NULL) {
     FT_Done_Face (self->priv->face);
@@ -686,6 +819,8 @@ sushi_font_widget_class_init (SushiFontWidgetClass *klass)
   oclass->constructed = sushi_font_widget_constructed;
 
   wclass->draw = sushi_font_widget_draw;
+  wclass->style_updated = sushi_font_widget_style_updated;
+  wclass->direction_changed = sushi_font_widget_direction_changed;
   wclass->get_preferred_width = sushi_font_widget_get_preferred_width;
   wclass->get_preferred_height = sushi_font_widget_get_preferred_height;
 
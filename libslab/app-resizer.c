@@ -93,20 +93,35 @@ app_resizer_layout_table_default (AppResizer * widget, CtkGrid * table, GList *
 	relayout_table (widget, table, element_list);
 }
 
+/* Moves the elements already in the table to their cell for the new number of columns,
+   without taking them out of the table and putting them back */
+static void
+reflow_table (CtkGrid * table, GList * element_list, gint columns)
+{
+	gint pos;
+
+	for (pos = 0; element_list != NULL; element_list = g_list_next (element_list), pos++)
+		ctk_container_child_set (CTK_CONTAINER (table), CTK_WIDGET (element_list->data),
+			"left-attach", pos % columns,
+			"top-attach", pos / columns,
+			NULL);
+}
+
 static void
 relayout_tables (AppResizer * widget, gint num_cols)
 {
 	CtkGrid *table;
 	GList *table_list, *launcher_list;
 
+	widget->column = num_cols;
+
 	for (table_list = widget->cached_tables_list; table_list != NULL;
 		table_list = g_list_next (table_list))
 	{
 		table = CTK_GRID (table_list->data);
 		launcher_list = ctk_container_get_children (CTK_CONTAINER (table));
 		launcher_list = g_list_reverse (launcher_list);	/* Fixme - ugly hack because table stores prepend */
-		resize_table (widget, table, num_cols);
-		relayout_table (widget, table, launcher_list);
+		reflow_table (table, launcher_list, num_cols);
 		g_list_free (launcher_list);
 	}
 }
@@ -44,8 +44,9 @@
 #include "application-tile.h"
 #include "themed-icon.h"
 
-#define TILE_EXEC_NAME "Tile_desktop_exec_name"
 #define SECONDS_IN_DAY 86400
+#define INITIAL_LAYOUT_ROWS 12	/* tile rows laid out before the shell is first shown */
+#define DEFERRED_LAYOUT_SLICE_USEC 8000
 #define CC_SCHEMA "org.cafe.control-center"
 #define EXIT_SHELL_ON_ACTION_START "cc-exit-shell-on-action-start"
 #define EXIT_SHELL_ON_ACTION_HELP "cc-exit-shell-on-action-help"
@@ -73,7 +74,7 @@ static void application_launcher_clear_search_bar (AppShellData * app_data);
 static void launch_selected_app (AppShellData * app_data);
 static void generate_potential_apps (gpointer catdata, gpointer user_data);
 
-static void relayout_shell (AppShellData * app_data);
+static void relayout_shell (AppShellData * app_data, gboolean only_changed);
 static gboolean handle_filter_changed (NldSearchBar * search_bar, const char *text,
 	gpointer user_data);
 static void handle_group_clicked (Tile * tile, TileEvent * event, gpointer user_data);
@@ -81,15 +82,26 @@ static void set_state (AppShellData * app_data, CtkWidget * widget);
 static void populate_groups_section (AppShellData * app_data);
 static void generate_filtered_lists (gpointer catdata, gpointer user_data);
 static void show_no_results_message (AppShellData * app_data, CtkWidget * containing_vbox);
+static void layout_application_category_sections (AppShellData * app_data,
+	CtkWidget * containing_vbox);
+static void cancel_deferred_layout (AppShellData * app_data);
+static CtkGrid *get_category_section_table (SlabSection * section);
+static gboolean layout_deferred_sections_through (AppShellData * app_data, CategoryData * target);
+static void category_layout_allocated_cb (CtkWidget * widget, CtkAllocation * allocation,
+	gpointer user_data);
 static void populate_application_category_sections (AppShellData * app_data,
 	CtkWidget * containing_vbox);
 static void populate_application_category_section (AppShellData * app_data, SlabSection * section,
 	GList * launcher_list);
+static void update_application_category_sections (AppShellData * app_data,
+	CtkWidget * containing_vbox);
+static CtkWidget *ensure_launcher_tile (LauncherData * launcher, AppShellData * app_data);
 static void tile_activated_cb (Tile * tile, TileEvent * event, gpointer user_data);
 static void handle_launcher_single_clicked (Tile * launcher, gpointer data);
 static void handle_menu_action_performed (Tile * launcher, TileEvent * event, TileAction * action,
 	gpointer data);
 static gint application_launcher_compare (gconstpointer a, gconstpointer b);
+static void sort_category_launchers (CategoryData * cat_data);
 static void cafemenu_tree_changed_callback (CafeMenuTree * tree, gpointer user_data);
 gboolean regenerate_categories (AppShellData * app_data);
 
@@ -148,18 +160,16 @@ generate_potential_apps (gpointer catdata, gpointer user_data)
 {
 	GHashTable *app_hash = (GHashTable *) user_data;
 	CategoryData *data = (CategoryData *) catdata;
-	gchar *uri;
 
 	GList *launcher_list = data->filtered_launcher_list;
 
 	while (launcher_list)
 	{
-		g_object_get (launcher_list->data, "tile-uri", &uri, NULL);
+		LauncherData *launcher = (LauncherData *) launcher_list->data;
+
 		/* eliminate dups of same app in multiple categories */
-		if (!g_hash_table_lookup (app_hash, uri))
-			g_hash_table_insert (app_hash, uri, launcher_list->data);
-		else
-			g_free (uri);
+		if (!g_hash_table_lookup (app_hash, launcher->uri))
+			g_hash_table_insert (app_hash, (gpointer) launcher->uri, launcher);
 		launcher_list = g_list_next (launcher_list);
 	}
 }
@@ -173,17 +183,17 @@ return_first_entry (gpointer key, gpointer value, gpointer unused)
 static void
 launch_selected_app (AppShellData * app_data)
 {
-	GHashTable *app_hash = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	GHashTable *app_hash = g_hash_table_new (g_str_hash, g_str_equal);
 	guint num_apps;
 
 	g_list_foreach (app_data->categories_list, generate_potential_apps, app_hash);
 	num_apps = g_hash_table_size (app_hash);
 	if (num_apps == 1)
 	{
-		ApplicationTile *launcher =
-			APPLICATION_TILE (g_hash_table_find (app_hash, return_first_entry, NULL));
+		LauncherData *launcher = g_hash_table_find (app_hash, return_first_entry, NULL);
 		g_hash_table_destroy (app_hash);
-		handle_launcher_single_clicked (TILE (launcher), app_data);
+		handle_launcher_single_clicked (TILE (ensure_launcher_tile (launcher, app_data)),
+			app_data);
 		return;
 	}
 
@@ -285,8 +295,11 @@ layout_shell (AppShellData * app_data, const gchar * filter_title, const gchar *
 	adjustment = ctk_scrolled_window_get_vadjustment (CTK_SCROLLED_WINDOW (sw));
 	g_object_set (adjustment, "step-increment", (double) 20, NULL);
 
+	g_signal_connect_after (app_data->category_layout, "size-allocate",
+		G_CALLBACK (category_layout_allocated_cb), app_data);
+
 	create_application_category_sections (app_data);
-	populate_application_category_sections (app_data, right_vbox);
+	layout_application_category_sections (app_data, right_vbox);
 	app_resizer_set_table_cache (APP_RESIZER (app_data->category_layout),
 		app_data->cached_tables_list);
 
@@ -359,6 +372,8 @@ relayout_shell_incremental (AppShellData * app_data)
 {
 	CtkBox *vbox = APP_RESIZER (app_data->category_layout)->child;
 
+	cancel_deferred_layout (app_data);
+
 	app_data->stop_incremental_relayout = FALSE;
 	app_data->filtered_out_everything = TRUE;
 	app_data->incremental_relayout_cat_list = app_data->categories_list;
@@ -373,12 +388,15 @@ relayout_shell_incremental (AppShellData * app_data)
 }
 
 static void
-relayout_shell (AppShellData * app_data)
+relayout_shell (AppShellData * app_data, gboolean only_changed)
 {
 	CtkWidget *shell = app_data->shell;
 	CtkBox *vbox = APP_RESIZER (app_data->category_layout)->child;
 
-	populate_application_category_sections (app_data, CTK_WIDGET (vbox));
+	if (only_changed)
+		update_application_category_sections (app_data, CTK_WIDGET (vbox));
+	else
+		populate_application_category_sections (app_data, CTK_WIDGET (vbox));
 	app_resizer_set_table_cache (APP_RESIZER (app_data->category_layout),
 		app_data->cached_tables_list);
 	populate_groups_section (app_data);
@@ -473,19 +491,55 @@ populate_groups_section (AppShellData * app_data)
 	while (NULL != (cat_list = g_list_next (cat_list)));
 }
 
+static void
+scroll_to_section (AppShellData * app_data, SlabSection * section)
+{
+	CtkAllocation allocation;
+	GList *cat_list;
+	gint total = 0;
+
+	for (cat_list = app_data->categories_list; cat_list; cat_list = g_list_next (cat_list))
+	{
+		CategoryData *cat_data = (CategoryData *) cat_list->data;
+
+		if (cat_data->section == section)
+			break;
+
+		if (NULL != cat_data->filtered_launcher_list)
+		{
+			ctk_widget_get_allocation (CTK_WIDGET (cat_data->section), &allocation);
+			total += allocation.height;
+		}
+	}
+
+	app_resizer_set_vadjustment_value (app_data->category_layout, total);
+}
+
+static void
+category_layout_allocated_cb (CtkWidget * widget, CtkAllocation * allocation,
+	gpointer user_data)
+{
+	AppShellData *app_data = (AppShellData *) user_data;
+	SlabSection *section = app_data->pending_scroll_section;
+
+	if (!section)
+		return;
+
+	app_data->pending_scroll_section = NULL;
+	scroll_to_section (app_data, section);
+}
+
 static void
 handle_group_clicked (Tile * tile, TileEvent * event, gpointer user_data)
 {
 	AppShellData *app_data = (AppShellData *) user_data;
-	CtkWidget *section = NULL;
-	CtkAllocation allocation;
+	CategoryData *target = NULL;
 
 	gint clicked_pos =
 		GPOINTER_TO_INT (g_object_get_data (G_OBJECT (tile), GROUP_POSITION_NUMBER_KEY));
 
 	GList *cat_list = app_data->categories_list;
 
-	gint total = 0;
 	do
 	{
 		CategoryData *cat_data = (CategoryData *) cat_list->data;
@@ -494,22 +548,26 @@ handle_group_clicked (Tile * tile, TileEvent * event, gpointer user_data)
 				GROUP_POSITION_NUMBER_KEY));
 		if (pos == clicked_pos)
 		{
-			section = CTK_WIDGET (cat_data->section);
+			target = cat_data;
 			break;
 		}
-
-		if (NULL != cat_data->filtered_launcher_list)
-		{
-			ctk_widget_get_allocation (CTK_WIDGET (cat_data->section), &allocation);
-			total += allocation.height;
-		}
 	}
 	while (NULL != (cat_list = g_list_next (cat_list)));
 
-	g_assert (section != NULL);
-	set_state (app_data, section);
+	g_assert (target != NULL);
+	set_state (app_data, CTK_WIDGET (target->section));
 
-	app_resizer_set_vadjustment_value (app_data->category_layout, total);
+	/* The sections above the clicked one only have their real height once their tiles are in,
+	   so lay them out now and scroll when they have been allocated */
+	if (layout_deferred_sections_through (app_data, target))
+	{
+		app_data->pending_scroll_section = target->section;
+		ctk_widget_queue_resize (app_data->category_layout);
+		return;
+	}
+
+	app_data->pending_scroll_section = NULL;
+	scroll_to_section (app_data, target->section);
 }
 
 static void
@@ -549,13 +607,38 @@ create_filter_section (AppShellData * app_data, const gchar * title)
 	return section;
 }
 
+/* casefolded and normalized, so that filtering is a plain strstr () */
+static gchar *
+get_search_key (const gchar * text)
+{
+	gchar *folded;
+	gchar *key;
+
+	if (!text)
+		return g_strdup ("");
+
+	folded = g_utf8_casefold (text, -1);
+	key = g_utf8_normalize (folded, -1, G_NORMALIZE_ALL);
+	if (!key)
+		return folded;
+
+	g_free (folded);
+	return key;
+}
+
 static gboolean
 handle_filter_changed_delayed (gpointer user_data)
 {
 	AppShellData *app_data = (AppShellData *) user_data;
+	gchar *filter_key = get_search_key (app_data->filter_string);
 
-	g_list_foreach (app_data->categories_list, generate_filtered_lists,
-		(gpointer) app_data->filter_string);
+	/* a query containing the previous one can only match a subset of its results */
+	app_data->filter_narrowing = app_data->filter_key
+		&& strstr (filter_key, app_data->filter_key) != NULL;
+	g_free (app_data->filter_key);
+	app_data->filter_key = filter_key;
+
+	g_list_foreach (app_data->categories_list, generate_filtered_lists, app_data);
 	app_data->last_clicked_launcher = NULL;
 
 	/*  showing the updates incremtally is very visually distracting. Much worse than just blanking until
@@ -572,6 +655,7 @@ handle_filter_changed_delayed (gpointer user_data)
 	g_object_unref (app_data->busy_cursor);
 
 	set_state (app_data, NULL);
+	app_data->pending_scroll_section = NULL;
 	app_resizer_set_vadjustment_value (app_data->category_layout, 0);
 
 	relayout_shell_incremental (app_data);
@@ -605,82 +689,183 @@ static void
 generate_filtered_lists (gpointer catdata, gpointer user_data)
 {
 	CategoryData *data = (CategoryData *) catdata;
+	AppShellData *app_data = (AppShellData *) user_data;
+	GList *launcher_list;
+	GList *filtered_list = NULL;
 
-	/* Fixme - everywhere you use ascii you need to fix up for multibyte */
-	gchar *filter_string = g_ascii_strdown (user_data, -1);
-	gchar *temp1, *temp2;
-	GList *launcher_list = data->launcher_list;
-
-	g_list_free (data->filtered_launcher_list);
-	data->filtered_launcher_list = NULL;
+	if (app_data->filter_narrowing)
+		launcher_list = data->filtered_launcher_list;
+	else
+		launcher_list = data->launcher_list;
 
-	do
+	for (; launcher_list; launcher_list = g_list_next (launcher_list))
 	{
-		ApplicationTile *launcher = APPLICATION_TILE (launcher_list->data);
-		const gchar *filename;
-
-		temp1 = NULL;
-		temp2 = NULL;
+		LauncherData *launcher = (LauncherData *) launcher_list->data;
 
 		/* Since the filter may remove this entry from the
 		   container it will not get a mouse out event */
-		ctk_widget_set_state (CTK_WIDGET (launcher), CTK_STATE_NORMAL);
-		filename = g_object_get_data (G_OBJECT (launcher), TILE_EXEC_NAME); /* do I need to free this */
-
-		temp1 = g_ascii_strdown (launcher->name, -1);
-		if (launcher->description)
-			temp2 = g_ascii_strdown (launcher->description, -1);
-		if (g_strrstr (temp1, filter_string) || (launcher->description
-				&& g_strrstr (temp2, filter_string))
-			|| g_strrstr (filename, filter_string))
-		{
-			data->filtered_launcher_list =
-				g_list_append (data->filtered_launcher_list, launcher);
-		}
-		if (temp1)
-			g_free (temp1);
-		if (temp2)
-			g_free (temp2);
+		if (launcher->tile)
+			ctk_widget_set_state (launcher->tile, CTK_STATE_NORMAL);
+
+		if (strstr (launcher->search_key, app_data->filter_key))
+			filtered_list = g_list_prepend (filtered_list, launcher);
+	}
+
+	g_list_free (data->filtered_launcher_list);
+	data->filtered_launcher_list = g_list_reverse (filtered_list);
+}
+
+static void
+destroy_launcher (LauncherData * launcher)
+{
+	if (launcher->tile)
+	{
+		ctk_widget_destroy (launcher->tile);
+		g_object_unref (launcher->tile);
 	}
-	while (NULL != (launcher_list = g_list_next (launcher_list)));
-	g_free (filter_string);
+
+	cafe_desktop_item_unref (launcher->item);
+	g_free (launcher->search_key);
+	g_free (launcher->collate_key);
+	g_free (launcher);
 }
 
 static void
-delete_old_data (AppShellData * app_data)
+delete_category_data (CategoryData * data)
 {
 	GList *temp;
+
+	ctk_widget_destroy (CTK_WIDGET (data->section));
+	ctk_widget_destroy (CTK_WIDGET (data->group_launcher));
+	g_object_unref (data->section);
+	g_object_unref (data->group_launcher);
+	g_free (data->category);
+
+	for (temp = data->launcher_list; temp; temp = g_list_next (temp))
+		destroy_launcher ((LauncherData *) temp->data);
+
+	g_list_free (data->launcher_list);
+	g_list_free (data->filtered_launcher_list);
+	g_free (data);
+}
+
+/* Move the current categories aside, so that regenerating them from the menu tree
+   can pick up the existing sections and tiles instead of creating new ones */
+static void
+stash_old_data (AppShellData * app_data)
+{
 	GList *cat_list;
 
 	g_assert (app_data != NULL);
 	g_assert (app_data->categories_list != NULL);
 
-	cat_list = app_data->categories_list;
+	app_data->reusable_categories = g_hash_table_new (g_str_hash, g_str_equal);
 
-	do
+	for (cat_list = app_data->categories_list; cat_list; cat_list = g_list_next (cat_list))
 	{
 		CategoryData *data = (CategoryData *) cat_list->data;
-		ctk_widget_destroy (CTK_WIDGET (data->section));
-		ctk_widget_destroy (CTK_WIDGET (data->group_launcher));
-		g_object_unref (data->section);
-		g_object_unref (data->group_launcher);
-		g_free (data->category);
 
-		for (temp = data->launcher_list; temp; temp = g_list_next (temp))
-		{
-			g_free (g_object_get_data (G_OBJECT (temp->data), TILE_EXEC_NAME));
-			g_object_unref (temp->data);
-		}
-
-		g_list_free (data->launcher_list);
-		g_list_free (data->filtered_launcher_list);
-		g_free (data);
+		if (!g_hash_table_contains (app_data->reusable_categories, data->category))
+			g_hash_table_insert (app_data->reusable_categories, data->category, data);
+		else
+			delete_category_data (data);
 	}
-	while (NULL != (cat_list = g_list_next (cat_list)));
 
 	g_list_free (app_data->categories_list);
 	app_data->categories_list = NULL;
 	app_data->selected_group = NULL;
+	app_data->pending_scroll_section = NULL;
+}
+
+/* Whatever was not picked up again is gone from the menu */
+static void
+delete_stashed_data (AppShellData * app_data)
+{
+	GHashTableIter iter;
+	gpointer data;
+
+	g_hash_table_iter_init (&iter, app_data->reusable_categories);
+	while (g_hash_table_iter_next (&iter, NULL, &data))
+		delete_category_data ((CategoryData *) data);
+
+	g_hash_table_destroy (app_data->reusable_categories);
+	app_data->reusable_categories = NULL;
+}
+
+static void
+reuse_category_data (CategoryData * data)
+{
+	GList *temp;
+
+	data->reusable_launchers = g_hash_table_new (g_str_hash, g_str_equal);
+	for (temp = data->launcher_list; temp; temp = g_list_next (temp))
+	{
+		LauncherData *launcher = (LauncherData *) temp->data;
+
+		/* the launcher now belongs to the hash */
+		g_hash_table_insert (data->reusable_launchers, (gpointer) launcher->uri, launcher);
+	}
+
+	g_list_free (data->launcher_list);
+	g_list_free (data->filtered_launcher_list);
+	data->launcher_list = NULL;
+	data->filtered_launcher_list = NULL;
+	data->launchers_changed = FALSE;
+}
+
+static void
+finish_reusing_category_data (CategoryData * data)
+{
+	GHashTableIter iter;
+	gpointer launcher;
+
+	g_hash_table_iter_init (&iter, data->reusable_launchers);
+	while (g_hash_table_iter_next (&iter, NULL, &launcher))
+	{
+		destroy_launcher ((LauncherData *) launcher);
+		data->launchers_changed = TRUE;
+	}
+
+	g_hash_table_destroy (data->reusable_launchers);
+	data->reusable_launchers = NULL;
+}
+
+static CategoryData *
+take_reusable_category (AppShellData * app_data, const gchar * category)
+{
+	CategoryData *data;
+
+	if (!app_data->reusable_categories)
+		return NULL;
+
+	data = g_hash_table_lookup (app_data->reusable_categories, category);
+	if (!data)
+		return NULL;
+
+	g_hash_table_steal (app_data->reusable_categories, category);
+	reuse_category_data (data);
+	return data;
+}
+
+static LauncherData *
+take_reusable_launcher (CategoryData * cat_data, CafeDesktopItem * desktop_item)
+{
+	const gchar *location = cafe_desktop_item_get_location (desktop_item);
+	LauncherData *launcher;
+
+	if (!cat_data->reusable_launchers || !location)
+		return NULL;
+
+	launcher = g_hash_table_lookup (cat_data->reusable_launchers, location);
+	if (!launcher)
+		return NULL;
+
+	/* the launcher shows what its desktop file said when it was loaded */
+	if (cafe_desktop_item_get_file_status (launcher->item) != CAFE_DESKTOP_ITEM_UNCHANGED)
+		return NULL;
+
+	g_hash_table_steal (cat_data->reusable_launchers, location);
+	return launcher;
 }
 
 static void
@@ -698,11 +883,21 @@ create_application_category_sections (AppShellData * app_data)
 	do
 	{
 		CategoryData *data = (CategoryData *) cat_list->data;
-		CtkWidget *header = ctk_label_new (data->category);
+		CtkWidget *header;
 		gchar *markup;
 		CtkWidget *hbox;
 		CtkWidget *table;
 
+		/* categories kept from before a regeneration only need their new position */
+		if (data->group_launcher)
+		{
+			g_object_set_data (G_OBJECT (data->group_launcher), GROUP_POSITION_NUMBER_KEY,
+				GINT_TO_POINTER (pos));
+			pos++;
+			continue;
+		}
+
+		header = ctk_label_new (data->category);
 		ctk_label_set_xalign (CTK_LABEL (header), 0.0);
 		data->group_launcher = TILE (nameplate_tile_new (NULL, NULL, header, NULL));
 		g_object_ref (data->group_launcher);
@@ -772,11 +967,179 @@ show_no_results_message (AppShellData * app_data, CtkWidget * containing_vbox)
 	g_free (markup);
 }
 
+/* Fills in the table of the first category still waiting for it, building its tiles */
+static CategoryData *
+layout_next_deferred_section (AppShellData * app_data)
+{
+	CategoryData *data = (CategoryData *) app_data->deferred_layout_cat_list->data;
+
+	app_data->deferred_layout_cat_list = g_list_next (app_data->deferred_layout_cat_list);
+
+	if (NULL != data->filtered_launcher_list)
+	{
+		populate_application_category_section (app_data, data->section,
+			data->filtered_launcher_list);
+		ctk_widget_show_all (CTK_WIDGET (data->section));
+	}
+
+	return data;
+}
+
+static gboolean
+layout_deferred_sections (gpointer user_data)
+{
+	AppShellData *app_data = (AppShellData *) user_data;
+	gint64 deadline = g_get_monotonic_time () + DEFERRED_LAYOUT_SLICE_USEC;
+
+	while (app_data->deferred_layout_cat_list)
+	{
+		layout_next_deferred_section (app_data);
+
+		if (g_get_monotonic_time () >= deadline)
+			break;
+	}
+
+	app_resizer_set_table_cache (APP_RESIZER (app_data->category_layout),
+		app_data->cached_tables_list);
+
+	if (app_data->deferred_layout_cat_list)
+		return TRUE;
+
+	app_data->deferred_layout_id = 0;
+	return FALSE;
+}
+
+/* Lays out right away the categories still waiting for it, up to and including target.
+   Returns whether there were any. */
+static gboolean
+layout_deferred_sections_through (AppShellData * app_data, CategoryData * target)
+{
+	if (!app_data->deferred_layout_id
+		|| !g_list_find (app_data->deferred_layout_cat_list, target))
+		return FALSE;
+
+	while (layout_next_deferred_section (app_data) != target)
+		;
+
+	app_resizer_set_table_cache (APP_RESIZER (app_data->category_layout),
+		app_data->cached_tables_list);
+
+	if (!app_data->deferred_layout_cat_list)
+	{
+		g_source_remove (app_data->deferred_layout_id);
+		app_data->deferred_layout_id = 0;
+	}
+
+	return TRUE;
+}
+
+/* Until its tiles are built, a section holds an empty table about as tall as they will
+   make it, so that the scrollbar does not jump as the sections fill in */
+static void
+set_placeholder_height (AppShellData * app_data, CategoryData * data, gint row_height)
+{
+	CtkGrid *table = get_category_section_table (data->section);
+	gint num_cols = APP_RESIZER (app_data->category_layout)->cur_num_cols;
+	gint rows = (g_list_length (data->filtered_launcher_list) + num_cols - 1) / num_cols;
+
+	ctk_widget_set_size_request (CTK_WIDGET (table), -1, rows * row_height);
+}
+
+/* Drop the sections whose tables were not filled in yet, whatever lays out the categories
+   next will pack them again */
+static void
+cancel_deferred_layout (AppShellData * app_data)
+{
+	CtkBox *vbox = APP_RESIZER (app_data->category_layout)->child;
+	GList *cat_list;
+
+	if (!app_data->deferred_layout_id)
+		return;
+
+	g_source_remove (app_data->deferred_layout_id);
+	app_data->deferred_layout_id = 0;
+
+	for (cat_list = app_data->deferred_layout_cat_list; cat_list;
+		cat_list = g_list_next (cat_list))
+	{
+		CategoryData *data = (CategoryData *) cat_list->data;
+		CtkWidget *section = CTK_WIDGET (data->section);
+
+		if (ctk_widget_get_parent (section))
+			ctk_container_remove (CTK_CONTAINER (vbox), section);
+	}
+	app_data->deferred_layout_cat_list = NULL;
+}
+
+/* Like populate_application_category_sections (), but only builds the tiles of the first
+   few categories, enough to cover what is visible when the shell is first shown. The other
+   sections are packed with empty tables as placeholders, and their tiles are built and
+   attached in short idle slices afterwards. */
+static void
+layout_application_category_sections (AppShellData * app_data, CtkWidget * containing_vbox)
+{
+	GList *cat_list;
+	gint num_cols = APP_RESIZER (app_data->category_layout)->cur_num_cols;
+	gint rows = 0;
+	gint row_height = 0;
+	gboolean filtered_out_everything = TRUE;
+
+	cancel_deferred_layout (app_data);
+
+	g_list_free (app_data->cached_tables_list);
+	app_data->cached_tables_list = NULL;
+
+	remove_container_entries (CTK_CONTAINER (containing_vbox));
+	for (cat_list = app_data->categories_list; cat_list; cat_list = g_list_next (cat_list))
+	{
+		CategoryData *data = (CategoryData *) cat_list->data;
+
+		if (NULL == data->filtered_launcher_list)
+			continue;
+
+		ctk_box_pack_start (CTK_BOX (containing_vbox), CTK_WIDGET (data->section),
+			TRUE, TRUE, 0);
+		filtered_out_everything = FALSE;
+
+		if (rows < INITIAL_LAYOUT_ROWS)
+		{
+			populate_application_category_section (app_data, data->section,
+				data->filtered_launcher_list);
+			rows += (g_list_length (data->filtered_launcher_list) + num_cols - 1) / num_cols;
+
+			if (!row_height)
+			{
+				LauncherData *first = (LauncherData *) data->filtered_launcher_list->data;
+
+				ctk_widget_get_preferred_height (first->tile, &row_height, NULL);
+				row_height += ctk_grid_get_row_spacing (get_category_section_table (data->section));
+			}
+		}
+		else
+		{
+			set_placeholder_height (app_data, data, row_height);
+
+			if (!app_data->deferred_layout_cat_list)
+				app_data->deferred_layout_cat_list = cat_list;
+		}
+	}
+
+	if (TRUE == filtered_out_everything)
+		show_no_results_message (app_data, containing_vbox);
+
+	if (app_data->deferred_layout_cat_list)
+		app_data->deferred_layout_id =
+			g_idle_add (layout_deferred_sections, app_data);
+}
+
 static void
 populate_application_category_sections (AppShellData * app_data, CtkWidget * containing_vbox)
 {
 	GList *cat_list = app_data->categories_list;
 	gboolean filtered_out_everything = TRUE;
+
+	cancel_deferred_layout (app_data);
+
 	if (app_data->cached_tables_list)
 		g_list_free (app_data->cached_tables_list);
 	app_data->cached_tables_list = NULL;
@@ -800,9 +1163,8 @@ populate_application_category_sections (AppShellData * app_data, CtkWidget * con
 		show_no_results_message (app_data, containing_vbox);
 }
 
-static void
-populate_application_category_section (AppShellData * app_data, SlabSection * section,
-	GList * launcher_list)
+static CtkGrid *
+get_category_section_table (SlabSection * section)
 {
 	CtkWidget *hbox;
 	CtkGrid *table;
@@ -817,20 +1179,96 @@ populate_application_category_section (AppShellData * app_data, SlabSection * se
 	/* Make sure our implementation has not changed and it's still a CtkGrid */
 	g_assert (CTK_IS_GRID (table));
 
+	return table;
+}
+
+/* Like populate_application_category_sections (), but keeps the sections and tables of the
+   categories whose launchers did not change since they were last laid out. Only valid when
+   nothing is filtered out. */
+static void
+update_application_category_sections (AppShellData * app_data, CtkWidget * containing_vbox)
+{
+	GList *cat_list;
+	gint pos = 0;
+
+	cancel_deferred_layout (app_data);
+
+	g_list_free (app_data->cached_tables_list);
+	app_data->cached_tables_list = NULL;
+
+	for (cat_list = app_data->categories_list; cat_list; cat_list = g_list_next (cat_list))
+	{
+		CategoryData *data = (CategoryData *) cat_list->data;
+		CtkWidget *section = CTK_WIDGET (data->section);
+
+		if (NULL == data->filtered_launcher_list)
+		{
+			if (ctk_widget_get_parent (section))
+				ctk_container_remove (CTK_CONTAINER (containing_vbox), section);
+			continue;
+		}
+
+		if (!ctk_widget_get_parent (section))
+		{
+			ctk_box_pack_start (CTK_BOX (containing_vbox), section, TRUE, TRUE, 0);
+			data->launchers_changed = TRUE;
+		}
+		ctk_box_reorder_child (CTK_BOX (containing_vbox), section, pos++);
+
+		if (data->launchers_changed)
+			populate_application_category_section (app_data, data->section,
+				data->filtered_launcher_list);
+		else
+			app_data->cached_tables_list = g_list_append (app_data->cached_tables_list,
+				get_category_section_table (data->section));
+
+		data->launchers_changed = FALSE;
+	}
+
+	if (pos == 0)
+		populate_application_category_sections (app_data, containing_vbox);
+}
+
+static void
+populate_application_category_section (AppShellData * app_data, SlabSection * section,
+	GList * launcher_list)
+{
+	CtkGrid *table = get_category_section_table (section);
+	GList *tiles = NULL;
+
+	for (; launcher_list; launcher_list = g_list_next (launcher_list))
+		tiles = g_list_prepend (tiles,
+			ensure_launcher_tile ((LauncherData *) launcher_list->data, app_data));
+	tiles = g_list_reverse (tiles);
+
 	app_data->cached_tables_list = g_list_append (app_data->cached_tables_list, table);
 
+	/* the tiles give the table its height from now on */
+	ctk_widget_set_size_request (CTK_WIDGET (table), -1, -1);
 	app_resizer_layout_table_default (APP_RESIZER (app_data->category_layout), table,
-		launcher_list);
+		tiles);
 
+	g_list_free (tiles);
 }
 
 gboolean
 regenerate_categories (AppShellData * app_data)
 {
-	delete_old_data (app_data);
+	/* a filtered view has its sections and tables rearranged, so it is laid out from scratch */
+	gboolean filtered = app_data->filter_key && app_data->filter_key[0] != '\0';
+
+	/* the list of categories still waiting to be laid out is about to go away */
+	cancel_deferred_layout (app_data);
+
+	/* the filtered lists are reset, the next filter has to look at everything */
+	g_free (app_data->filter_key);
+	app_data->filter_key = NULL;
+
+	stash_old_data (app_data);
 	generate_categories (app_data);
+	delete_stashed_data (app_data);
 	create_application_category_sections (app_data);
-	relayout_shell (app_data);
+	relayout_shell (app_data, !filtered);
 
 	return FALSE;	/* remove this function from the list */
 }
@@ -959,8 +1397,13 @@ generate_category (const char * category, CafeMenuTreeDirectory * root_dir, AppS
 	if (!list_entry)
 	{
 	*/
-		data = g_new0 (CategoryData, 1);
-		data->category = g_strdup (category);
+		data = take_reusable_category (app_data, category);
+		if (!data)
+		{
+			data = g_new0 (CategoryData, 1);
+			data->category = g_strdup (category);
+			data->launchers_changed = TRUE;
+		}
 		app_data->categories_list =
 			/* use the cafemenu order instead of alphabetical */
 			g_list_append (app_data->categories_list, data);
@@ -977,6 +1420,10 @@ generate_category (const char * category, CafeMenuTreeDirectory * root_dir, AppS
 		g_hash_table_destroy (app_data->hash);
 	app_data->hash = g_hash_table_new (g_str_hash, g_str_equal);
 	generate_launchers (root_dir, app_data, data, recursive);
+	sort_category_launchers (data);
+
+	if (data->reusable_launchers)
+		finish_reusing_category_data (data);
 }
 
 static gboolean
@@ -1124,10 +1571,7 @@ generate_new_apps (AppShellData * app_data)
 			CategoryData *data = categories->data;
 			for (launchers = data->launcher_list; launchers; launchers = launchers->next)
 			{
-				Tile *tile = TILE (launchers->data);
-				CafeDesktopItem *item =
-					application_tile_get_desktop_item (APPLICATION_TILE (tile));
-				const gchar *uri = cafe_desktop_item_get_location (item);
+				const gchar *uri = ((LauncherData *) launchers->data)->uri;
 				g_string_append (gstr, uri);
 				g_string_append (gstr, separator);
 			}
@@ -1159,10 +1603,9 @@ generate_new_apps (AppShellData * app_data)
 		CategoryData *cat_data = categories->data;
 		for (launchers = cat_data->launcher_list; launchers; launchers = launchers->next)
 		{
-			Tile *tile = TILE (launchers->data);
-			CafeDesktopItem *item =
-				application_tile_get_desktop_item (APPLICATION_TILE (tile));
-			const gchar *uri = cafe_desktop_item_get_location (item);
+			LauncherData *launcher = (LauncherData *) launchers->data;
+			CafeDesktopItem *item = launcher->item;
+			const gchar *uri = launcher->uri;
 			if (!g_hash_table_lookup (all_apps_cache, uri))
 			{
 				GFile *file;
@@ -1249,6 +1692,7 @@ generate_new_apps (AppShellData * app_data)
 			else
 				break;
 		}
+		sort_category_launchers (new_apps_category);
 		app_data->categories_list =
 			g_list_prepend (app_data->categories_list, new_apps_category);
 
@@ -1259,24 +1703,29 @@ generate_new_apps (AppShellData * app_data)
 	g_strfreev (all_apps_split);
 }
 
-static void
-insert_launcher_into_category (CategoryData * cat_data, CafeDesktopItem * desktop_item,
-	AppShellData * app_data)
+/* Everything the shell needs to know about a launcher before its tile is built */
+static LauncherData *
+create_launcher_data (CafeDesktopItem * desktop_item)
 {
-	CtkWidget *launcher;
-	static CtkSizeGroup *icon_group = NULL;
-
+	LauncherData *launcher;
+	const gchar *name;
 	gchar *filepath;
 	gchar *filename;
-	CtkWidget *tile_icon;
+	const gchar *search_fields[5];
+	GString *search_text;
+	gchar *folded_name;
+	guint i;
 
-	if (!icon_group)
-		icon_group = ctk_size_group_new (CTK_SIZE_GROUP_HORIZONTAL);
+	/* the same items application_tile_new_for_item () would refuse */
+	if (cafe_desktop_item_get_entry_type (desktop_item) != CAFE_DESKTOP_ITEM_TYPE_APPLICATION
+		|| !cafe_desktop_item_get_location (desktop_item))
+		return NULL;
 
-	launcher =
-		application_tile_new_full (cafe_desktop_item_get_location (desktop_item),
-		app_data->icon_size, app_data->show_tile_generic_name);
-	ctk_widget_set_size_request (launcher, SIZING_TILE_WIDTH, -1);
+	launcher = g_new0 (LauncherData, 1);
+	launcher->item = cafe_desktop_item_ref (desktop_item);
+	launcher->uri = cafe_desktop_item_get_location (desktop_item);
+
+	name = cafe_desktop_item_get_localestring (desktop_item, CAFE_DESKTOP_ITEM_NAME);
 
 	filepath =
 		g_strdup (cafe_desktop_item_get_string (desktop_item, CAFE_DESKTOP_ITEM_EXEC));
@@ -1284,9 +1733,48 @@ insert_launcher_into_category (CategoryData * cat_data, CafeDesktopItem * deskto
 	filename = g_strrstr (filepath, "/");
 	if (filename)
 		g_stpcpy (filepath, filename + 1);
-	filename = g_ascii_strdown (filepath, -1);
+
+	/* everything the filter matches, folded once here rather than on every keystroke */
+	search_fields[0] = name;
+	search_fields[1] = cafe_desktop_item_get_localestring (desktop_item, CAFE_DESKTOP_ITEM_GENERIC_NAME);
+	search_fields[2] = cafe_desktop_item_get_localestring (desktop_item, "Keywords");
+	search_fields[3] = cafe_desktop_item_get_localestring (desktop_item, CAFE_DESKTOP_ITEM_COMMENT);
+	search_fields[4] = filepath;
+
+	search_text = g_string_new (NULL);
+	for (i = 0; i < G_N_ELEMENTS (search_fields); i++)
+	{
+		if (!search_fields[i])
+			continue;
+		g_string_append (search_text, search_fields[i]);
+		g_string_append_c (search_text, '\n');
+	}
+	launcher->search_key = get_search_key (search_text->str);
+	g_string_free (search_text, TRUE);
 	g_free (filepath);
-	g_object_set_data (G_OBJECT (launcher), TILE_EXEC_NAME, filename);
+
+	folded_name = g_utf8_casefold (name ? name : "", -1);
+	launcher->collate_key = g_utf8_collate_key (folded_name, -1);
+	g_free (folded_name);
+
+	return launcher;
+}
+
+static CtkWidget *
+create_launcher (CafeDesktopItem * desktop_item, AppShellData * app_data)
+{
+	CtkWidget *launcher;
+	static CtkSizeGroup *icon_group = NULL;
+
+	CtkWidget *tile_icon;
+
+	if (!icon_group)
+		icon_group = ctk_size_group_new (CTK_SIZE_GROUP_HORIZONTAL);
+
+	launcher =
+		application_tile_new_for_item (desktop_item,
+		app_data->icon_size, app_data->show_tile_generic_name);
+	ctk_widget_set_size_request (launcher, SIZING_TILE_WIDTH, -1);
 
 	tile_icon = NAMEPLATE_TILE (launcher)->image;
 	ctk_size_group_add_widget (icon_group, tile_icon);
@@ -1304,30 +1792,62 @@ insert_launcher_into_category (CategoryData * cat_data, CafeDesktopItem * deskto
 	/* destroyed when they are removed */
 	g_object_ref (launcher);
 
+	return launcher;
+}
+
+/* Building a tile (its header, context menu, icon, autostart and bookmark state) is what makes
+   a launcher costly, so it only happens when the launcher is laid out or activated */
+static CtkWidget *
+ensure_launcher_tile (LauncherData * launcher, AppShellData * app_data)
+{
+	if (!launcher->tile)
+		launcher->tile = create_launcher (launcher->item, app_data);
+
+	return launcher->tile;
+}
+
+static void
+insert_launcher_into_category (CategoryData * cat_data, CafeDesktopItem * desktop_item,
+	AppShellData * app_data)
+{
+	LauncherData *launcher;
+
+	/* when regenerating, keep the existing launcher of an unchanged desktop file */
+	launcher = take_reusable_launcher (cat_data, desktop_item);
+	if (!launcher)
+	{
+		launcher = create_launcher_data (desktop_item);
+		if (!launcher)
+			return;
+		cat_data->launchers_changed = TRUE;
+	}
+
+	/* sorted by sort_category_launchers () once the category is complete */
+	cat_data->launcher_list = g_list_prepend (cat_data->launcher_list, launcher);
+}
+
+static void
+sort_category_launchers (CategoryData * cat_data)
+{
 	/* use alphabetical order instead of the cafemenu order. We group all sub items in each top level
 	category together, ignoring sub menus, so we also ignore sub menu layout hints */
-	cat_data->launcher_list =
-		/* g_list_insert (cat_data->launcher_list, launcher, -1); */
-		g_list_insert_sorted (cat_data->launcher_list, launcher, application_launcher_compare);
-	cat_data->filtered_launcher_list =
-		/* g_list_insert (cat_data->filtered_launcher_list, launcher, -1); */
-		g_list_insert_sorted (cat_data->filtered_launcher_list, launcher, application_launcher_compare);
+	cat_data->launcher_list = g_list_sort (cat_data->launcher_list, application_launcher_compare);
+
+	g_list_free (cat_data->filtered_launcher_list);
+	cat_data->filtered_launcher_list = g_list_copy (cat_data->launcher_list);
 }
 
 static gint
 application_launcher_compare (gconstpointer a, gconstpointer b)
 {
-	ApplicationTile *launcher1 = APPLICATION_TILE (a);
-	ApplicationTile *launcher2 = APPLICATION_TILE (b);
-
-	gchar *val1 = launcher1->name;
-	gchar *val2 = launcher2->name;
+	const gchar *val1 = ((const LauncherData *) a)->collate_key;
+	const gchar *val2 = ((const LauncherData *) b)->collate_key;
 
 	if (val1 == NULL || val2 == NULL)
 	{
 		g_assert_not_reached ();
 	}
-	return g_ascii_strcasecmp (val1, val2);
+	return strcmp (val1, val2);
 }
 
 static void
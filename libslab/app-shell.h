@@ -74,6 +74,8 @@ typedef struct _AppShellData
 
 	CtkWidget *filter_section;
 	gchar *filter_string;
+	gchar *filter_key;	/* folded filter_string the filtered lists were built for */
+	gboolean filter_narrowing;
 	CdkCursor *busy_cursor;
 
 	CtkWidget *category_layout;
@@ -81,15 +83,19 @@ typedef struct _AppShellData
 	GList *cached_tables_list;	/* list of currently showing (not filtered out) tables */
 	Tile *last_clicked_launcher;
 	SlabSection *selected_group;
+	SlabSection *pending_scroll_section;	/* scrolled to once the layout is allocated */
 	CtkIconSize icon_size;
 	const gchar *menu_name;
 	NewAppConfig *new_apps;
 	CafeMenuTree *tree;
 	GHashTable *hash;
+	GHashTable *reusable_categories;	/* only set while regenerating */
 
 	guint filter_changed_timeout;
 	gboolean stop_incremental_relayout;
 	GList *incremental_relayout_cat_list;
+	guint deferred_layout_id;
+	GList *deferred_layout_cat_list;	/* first category whose table is still empty */
 	gboolean filtered_out_everything;
 	CtkWidget *filtered_out_everything_widget;
 	CtkLabel *filtered_out_everything_widget_label;
@@ -100,14 +106,26 @@ typedef struct _AppShellData
 	GSettings *settings;
 } AppShellData;
 
+typedef struct
+{
+	CafeDesktopItem *item;
+	const gchar *uri;	/* location of item */
+	gchar *search_key;
+	gchar *collate_key;
+	CtkWidget *tile;	/* NULL until the launcher is first laid out or activated */
+} LauncherData;
+
 typedef struct
 {
 	gchar *category;
 	Tile *group_launcher;
 
 	SlabSection *section;
-	GList *launcher_list;
+	GList *launcher_list;	/* of LauncherData */
 	GList *filtered_launcher_list;
+
+	GHashTable *reusable_launchers;	/* only set while regenerating */
+	gboolean launchers_changed;
 } CategoryData;
 
 typedef struct
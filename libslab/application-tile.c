@@ -81,6 +81,11 @@ typedef struct {
 	gulong               notify_signal_id;
 } ApplicationTilePrivate;
 
+static struct {
+	GHashTable *system_entries;
+	GHashTable *user_entries;
+} autostart_dirs = { NULL, NULL };
+
 enum {
 	PROP_0,
 	PROP_APPLICATION_NAME,
@@ -122,35 +127,43 @@ application_tile_new (const gchar *desktop_item_id)
 CtkWidget *
 application_tile_new_full (const gchar *desktop_item_id,
 	CtkIconSize image_size, gboolean show_generic_name)
+{
+	CafeDesktopItem *desktop_item;
+	CtkWidget *tile;
+
+
+	desktop_item = load_desktop_item_from_unknown (desktop_item_id);
+
+	if (! desktop_item)
+		return NULL;
+
+	tile = application_tile_new_for_item (desktop_item, image_size, show_generic_name);
+	cafe_desktop_item_unref (desktop_item);
+
+	return tile;
+}
+
+CtkWidget *
+application_tile_new_for_item (CafeDesktopItem *desktop_item,
+	CtkIconSize image_size, gboolean show_generic_name)
 {
 	ApplicationTile        *this;
 	ApplicationTilePrivate *priv;
 
 	const gchar *uri = NULL;
 
-	CafeDesktopItem *desktop_item;
-
-
-	desktop_item = load_desktop_item_from_unknown (desktop_item_id);
 
-	if (
-		desktop_item &&
-		cafe_desktop_item_get_entry_type (desktop_item) == CAFE_DESKTOP_ITEM_TYPE_APPLICATION
-	)
+	if (cafe_desktop_item_get_entry_type (desktop_item) == CAFE_DESKTOP_ITEM_TYPE_APPLICATION)
 		uri = cafe_desktop_item_get_location (desktop_item);
 
-	if (! uri) {
-		if (desktop_item)
-			cafe_desktop_item_unref (desktop_item);
-
+	if (! uri)
 		return NULL;
-	}
 
 	this = g_object_new (APPLICATION_TILE_TYPE, "tile-uri", uri, NULL);
 	priv = application_tile_get_instance_private (this);
 
 	priv->image_size   = image_size;
-	priv->desktop_item = desktop_item;
+	priv->desktop_item = cafe_desktop_item_ref (desktop_item);
 	priv->show_generic_name = show_generic_name;
 
 	application_tile_setup (this);
@@ -265,10 +278,10 @@ application_tile_setup (ApplicationTile *this)
 	CtkWidget    *menu_item;
 	CtkContainer *menu_ctnr;
 
-	gchar *name;
-	gchar *desc;
+	const gchar *name;
+	const gchar *desc;
 
-	gchar *comment;
+	const gchar *comment;
 
 	gchar *markup;
 	gchar *str;
@@ -283,13 +296,9 @@ application_tile_setup (ApplicationTile *this)
 	priv->image_id = g_strdup (cafe_desktop_item_get_localestring (priv->desktop_item, "Icon"));
 	image = themed_icon_new (priv->image_id, priv->image_size);
 
-	gchar *filename = g_filename_from_uri (cafe_desktop_item_get_location (priv->desktop_item), NULL, NULL);
-	GKeyFile *keyfile = g_key_file_new ();
-	g_key_file_load_from_file (keyfile, filename, G_KEY_FILE_KEEP_COMMENTS | G_KEY_FILE_KEEP_TRANSLATIONS, NULL);
-
-	name = g_key_file_get_locale_string (keyfile, G_KEY_FILE_DESKTOP_GROUP, "Name", NULL, NULL);
-	desc = g_key_file_get_locale_string (keyfile, G_KEY_FILE_DESKTOP_GROUP, "GenericName", NULL, NULL);
-	comment = g_key_file_get_locale_string (keyfile, G_KEY_FILE_DESKTOP_GROUP, "Comment", NULL, NULL);
+	name = cafe_desktop_item_get_localestring (priv->desktop_item, CAFE_DESKTOP_ITEM_NAME);
+	desc = cafe_desktop_item_get_localestring (priv->desktop_item, CAFE_DESKTOP_ITEM_GENERIC_NAME);
+	comment = cafe_desktop_item_get_localestring (priv->desktop_item, CAFE_DESKTOP_ITEM_COMMENT);
 
 	accessible = ctk_widget_get_accessible (CTK_WIDGET (this));
 	if (name)
@@ -392,12 +401,6 @@ application_tile_setup (ApplicationTile *this)
 	}
 
 	ctk_widget_show_all (CTK_WIDGET (TILE (this)->context_menu));
-
-	g_free (name);
-	g_free (desc);
-	g_free (comment);
-	g_free (filename);
-	g_key_file_unref (keyfile);
 }
 
 static CtkWidget *
@@ -552,6 +555,9 @@ add_to_startup_list (ApplicationTile *this)
 	copy_file (src_uri, dst_uri);
 	priv->startup_status = APP_IN_USER_STARTUP_DIR;
 
+	if (autostart_dirs.user_entries)
+		g_hash_table_add (autostart_dirs.user_entries, g_strdup (desktop_item_basename));
+
 	g_free (desktop_item_filename);
 	g_free (desktop_item_basename);
 	g_free (startup_dir);
@@ -579,6 +585,10 @@ remove_from_startup_list (ApplicationTile *this)
 	src_filename = g_build_filename (g_get_user_config_dir (), "autostart", ditem_basename, NULL);
 
 	priv->startup_status = APP_NOT_IN_STARTUP_DIR;
+
+	if (autostart_dirs.user_entries)
+		g_hash_table_remove (autostart_dirs.user_entries, ditem_basename);
+
 	if (g_file_test (src_filename, G_FILE_TEST_EXISTS))
 	{
 		if(g_file_test (src_filename, G_FILE_TEST_IS_DIR))
@@ -653,62 +663,89 @@ update_user_list_menu_item (ApplicationTile *this)
 	ctk_widget_set_sensitive (item, (priv->agent_status != BOOKMARK_STORE_DEFAULT_ONLY));
 }
 
+static void
+add_autostart_dir_entries (GHashTable *entries, const gchar *path)
+{
+	GDir *dir;
+	const gchar *name;
+
+	dir = g_dir_open (path, 0, NULL);
+	if (! dir)
+		return;
+
+	while ((name = g_dir_read_name (dir)) != NULL)
+		g_hash_table_add (entries, g_strdup (name));
+
+	g_dir_close (dir);
+}
+
+static gboolean
+autostart_dirs_expire (gpointer user_data)
+{
+	g_clear_pointer (&autostart_dirs.system_entries, g_hash_table_destroy);
+	g_clear_pointer (&autostart_dirs.user_entries, g_hash_table_destroy);
+
+	return G_SOURCE_REMOVE;
+}
+
+/* Tiles are created in bursts, so the autostart dirs are listed once for all the tiles
+ * of a burst and forgotten as soon as the main loop is idle again. */
+static void
+ensure_autostart_dirs (void)
+{
+	const gchar * const * global_dirs;
+	gchar *path;
+	gint x;
+
+	if (autostart_dirs.system_entries)
+		return;
+
+	autostart_dirs.system_entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	autostart_dirs.user_entries   = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	global_dirs = g_get_system_config_dirs ();
+	for (x = 0; global_dirs [x]; x++) {
+		path = g_build_filename (global_dirs [x], "autostart", NULL);
+		add_autostart_dir_entries (autostart_dirs.system_entries, path);
+		g_free (path);
+	}
+
+	/* cafe-session currently checks these dirs also. see startup-programs.c */
+	global_dirs = g_get_system_data_dirs ();
+	for (x = 0; global_dirs [x]; x++) {
+		path = g_build_filename (global_dirs [x], "cafe", "autostart", NULL);
+		add_autostart_dir_entries (autostart_dirs.system_entries, path);
+		g_free (path);
+	}
+
+	path = g_build_filename (g_get_user_config_dir (), "autostart", NULL);
+	add_autostart_dir_entries (autostart_dirs.user_entries, path);
+	g_free (path);
+
+	g_idle_add (autostart_dirs_expire, NULL);
+}
+
 static StartupStatus
 get_desktop_item_startup_status (CafeDesktopItem *desktop_item)
 {
 	gchar *filename;
 	gchar *basename;
 
-	const gchar * const * global_dirs;
-	gchar *global_target;
-	gchar *user_target;
-
 	StartupStatus retval;
-	gint x;
 
 	filename = g_filename_from_uri (cafe_desktop_item_get_location (desktop_item), NULL, NULL);
 	if (!filename)
 		return APP_NOT_ELIGIBLE;
 	basename = g_path_get_basename (filename);
 
-	retval = APP_NOT_IN_STARTUP_DIR;
-	global_dirs = g_get_system_config_dirs();
-	for(x=0; global_dirs[x]; x++)
-	{
-		global_target = g_build_filename (global_dirs[x], "autostart", basename, NULL);
-		if (g_file_test (global_target, G_FILE_TEST_EXISTS))
-		{
-			retval = APP_NOT_ELIGIBLE;
-			g_free (global_target);
-			break;
-		}
-		g_free (global_target);
-	}
-
-	/* cafe-session currently checks these dirs also. see startup-programs.c */
-	if (retval != APP_NOT_ELIGIBLE)
-	{
-		global_dirs = g_get_system_data_dirs();
-		for(x=0; global_dirs[x]; x++)
-		{
-			global_target = g_build_filename (global_dirs[x], "cafe", "autostart", basename, NULL);
-			if (g_file_test (global_target, G_FILE_TEST_EXISTS))
-			{
-				retval = APP_NOT_ELIGIBLE;
-				g_free (global_target);
-				break;
-			}
-			g_free (global_target);
-		}
-	}
+	ensure_autostart_dirs ();
 
-	if (retval != APP_NOT_ELIGIBLE)
-	{
-		user_target = g_build_filename (g_get_user_config_dir (), "autostart", basename, NULL);
-		if (g_file_test (user_target, G_FILE_TEST_EXISTS))
-			retval = APP_IN_USER_STARTUP_DIR;
-		g_free (user_target);
-	}
+	if (g_hash_table_contains (autostart_dirs.system_entries, basename))
+		retval = APP_NOT_ELIGIBLE;
+	else if (g_hash_table_contains (autostart_dirs.user_entries, basename))
+		retval = APP_IN_USER_STARTUP_DIR;
+	else
+		retval = APP_NOT_IN_STARTUP_DIR;
 
 	g_free (basename);
 	g_free (filename);
@@ -60,6 +60,8 @@ GType application_tile_get_type (void);
 CtkWidget *application_tile_new (const gchar * desktop_item_id);
 CtkWidget *application_tile_new_full (const gchar * desktop_item_id,
 	CtkIconSize icon_size, gboolean show_generic_name);
+CtkWidget *application_tile_new_for_item (CafeDesktopItem * desktop_item,
+	CtkIconSize icon_size, gboolean show_generic_name);
 
 CafeDesktopItem *application_tile_get_desktop_item (ApplicationTile * tile);
 
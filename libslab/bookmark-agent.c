@@ -45,6 +45,8 @@
 
 #define CTK_BOOKMARKS_FILE "bookmarks"
 
+#define SAVE_STORE_DELAY_MS 500
+
 #define TYPE_IS_RECENT(type) ((type) == BOOKMARK_STORE_RECENT_APPS || (type) == BOOKMARK_STORE_RECENT_DOCS)
 
 typedef struct {
@@ -55,6 +57,7 @@ typedef struct {
 	BookmarkStoreStatus      status;
 
 	GBookmarkFile           *store;
+	GHashTable              *ranks;
 	gboolean                 needs_sync;
 
 	gchar                   *store_path;
@@ -66,6 +69,9 @@ typedef struct {
 	GFileMonitor            *store_monitor;
 	GFileMonitor            *user_store_monitor;
 
+	guint                    save_source_id;
+	gchar                   *saved_etag;
+
 	void                  (* update_path) (BookmarkAgent *);
 	void                  (* load_store)  (BookmarkAgent *);
 	void                  (* save_store)  (BookmarkAgent *);
@@ -97,9 +103,13 @@ static void finalize     (GObject *);
 static void update_agent (BookmarkAgent *);
 static void update_items (BookmarkAgent *);
 static void save_store   (BookmarkAgent *);
+static void flush_store  (BookmarkAgent *);
 static gint get_rank     (BookmarkAgent *, const gchar *);
 static void set_rank     (BookmarkAgent *, const gchar *, gint);
 
+static void load_rank_index  (BookmarkAgent *);
+static void write_rank_index (BookmarkAgent *);
+
 static void load_xbel_store          (BookmarkAgent *);
 static void load_places_store        (BookmarkAgent *);
 static void update_user_spec_path    (BookmarkAgent *);
@@ -242,6 +252,7 @@ bookmark_agent_purge_items (BookmarkAgent *this)
 		for (i = 0; i < uris_len; i++) {
 			g_bookmark_file_remove_item (priv->store, uris [i], NULL);
 		}
+		g_hash_table_remove_all (priv->ranks);
 		save_store (this);
 	}
 	g_strfreev (uris);
@@ -255,9 +266,8 @@ bookmark_agent_remove_item (BookmarkAgent *this, const gchar *uri)
 
         GError *error = NULL;
 
-        gchar **uris = NULL;
-        gint    rank_i;
-        gint    i;
+        GHashTableIter iter;
+        gpointer       rank_i;
 
 
         g_return_if_fail (priv->user_modifiable);
@@ -276,18 +286,14 @@ bookmark_agent_remove_item (BookmarkAgent *this, const gchar *uri)
 		rank = get_rank (this, uri);
 
 		g_bookmark_file_remove_item (priv->store, uri, NULL);
+		g_hash_table_remove (priv->ranks, uri);
 
 		if (rank >= 0) {
-			uris = g_bookmark_file_get_uris (priv->store, NULL);
-
-			for (i =  0; uris && uris [i]; ++i) {
-				rank_i = get_rank (this, uris [i]);
+			g_hash_table_iter_init (& iter, priv->ranks);
 
-				if (rank_i > rank)
-					set_rank (this, uris [i], rank_i - 1);
-			}
-
-			g_strfreev (uris);
+			while (g_hash_table_iter_next (& iter, NULL, & rank_i))
+				if (GPOINTER_TO_INT (rank_i) > rank)
+					g_hash_table_iter_replace (& iter, GINT_TO_POINTER (GPOINTER_TO_INT (rank_i) - 1));
 		}
 
 		save_store (this);
@@ -367,6 +373,7 @@ bookmark_agent_update_from_bookmark_file (BookmarkAgent *this, GBookmarkFile *st
 
 	g_bookmark_file_free (priv->store);
 	priv->store = g_bookmark_file_new ();
+	g_hash_table_remove_all (priv->ranks);
 
 	for (node = items_ordered; node; node = node->next) {
 		BookmarkItem *item;
@@ -451,6 +458,7 @@ bookmark_agent_init (BookmarkAgent *this)
 	priv->status              = BOOKMARK_STORE_ABSENT;
 
 	priv->store               = NULL;
+	priv->ranks               = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 	priv->needs_sync          = FALSE;
 
 	priv->store_path          = NULL;
@@ -462,6 +470,9 @@ bookmark_agent_init (BookmarkAgent *this)
 	priv->store_monitor       = NULL;
 	priv->user_store_monitor  = NULL;
 
+	priv->save_source_id      = 0;
+	priv->saved_etag          = NULL;
+
 	priv->update_path         = NULL;
 	priv->load_store          = NULL;
 	priv->save_store          = NULL;
@@ -595,10 +606,14 @@ finalize (GObject *g_obj)
 	gint i;
 
 
+	if (priv->save_source_id)
+		flush_store (this);
+
 	for (i = 0; priv->items && priv->items [i]; ++i)
 		bookmark_item_free (priv->items [i]);
 
 	g_free (priv->items);
+	g_free (priv->saved_etag);
 	g_free (priv->store_path);
 	g_free (priv->user_store_path);
 	g_free (priv->ctk_store_path);
@@ -622,6 +637,7 @@ finalize (GObject *g_obj)
 	}
 
 	g_bookmark_file_free (priv->store);
+	g_hash_table_destroy (priv->ranks);
 
 	G_OBJECT_CLASS (bookmark_agent_parent_class)->finalize (g_obj);
 }
@@ -637,6 +653,7 @@ update_agent (BookmarkAgent *this)
 	if (priv->load_store)
 		priv->load_store (this);
 
+	load_rank_index (this);
 	update_items (this);
 }
 
@@ -741,85 +758,173 @@ update_items (BookmarkAgent *this)
 	g_free (uris_ordered);
 }
 
+static gboolean
+save_store_timeout_cb (gpointer user_data)
+{
+	BookmarkAgent *this = BOOKMARK_AGENT (user_data);
+	BookmarkAgentPrivate *priv = bookmark_agent_get_instance_private (this);
+
+	priv->save_source_id = 0;
+	flush_store (this);
+
+	return FALSE;
+}
+
+/* The items are updated right away, but the file is only written SAVE_STORE_DELAY_MS after the
+ * first of a series of changes, so that a burst of edits, e.g. a drag and drop reordering a
+ * whole menu, costs a single write. */
 static void
 save_store (BookmarkAgent *this)
 {
 	BookmarkAgentPrivate *priv = bookmark_agent_get_instance_private (this);
 
-	gchar *dir;
-
 
 	g_return_if_fail (priv->user_modifiable);
 
 	priv->needs_sync = TRUE;
 	priv->update_path (this);
 
+	if (! priv->save_source_id)
+		priv->save_source_id = g_timeout_add (SAVE_STORE_DELAY_MS, save_store_timeout_cb, this);
+
+	update_items (this);
+}
+
+static void
+flush_store (BookmarkAgent *this)
+{
+	BookmarkAgentPrivate *priv = bookmark_agent_get_instance_private (this);
+
+	gchar *dir;
+
+
+	if (priv->save_source_id) {
+		g_source_remove (priv->save_source_id);
+		priv->save_source_id = 0;
+	}
+
+	if (! priv->save_store)
+		return;
+
 	dir = g_path_get_dirname (priv->store_path);
 	g_mkdir_with_parents (dir, 0700);
 	g_free (dir);
 
+	write_rank_index (this);
 	priv->save_store (this);
-	update_items (this);
 }
 
-static gint
-get_rank (BookmarkAgent *this, const gchar *uri)
+/* The ranks live in "rank-N" groups of the bookmark file. They are read into priv->ranks
+ * when the store is loaded, kept there while items are added, removed and reordered, and
+ * only written back to the groups when the store is saved. */
+
+static void
+load_rank_index (BookmarkAgent *this)
 {
 	BookmarkAgentPrivate *priv = bookmark_agent_get_instance_private (this);
 
+	gchar **uris;
 	gchar **groups;
 	gint    rank;
 
-	gint i;
+	gint i, j;
 
 
+	g_hash_table_remove_all (priv->ranks);
+
 	if (! priv->reorderable)
-		return -1;
+		return;
 
-	groups = g_bookmark_file_get_groups (priv->store, uri, NULL, NULL);
-	rank   = -1;
+	uris = g_bookmark_file_get_uris (priv->store, NULL);
 
-	for (i = 0; groups && groups [i]; ++i) {
-		if (g_str_has_prefix (groups [i], "rank-")) {
-			if (rank >= 0)
-				g_warning (
-					"store corruption - multiple ranks for same uri: [%s] [%s]",
-					priv->store_path, uri);
+	for (i = 0; uris && uris [i]; ++i) {
+		groups = g_bookmark_file_get_groups (priv->store, uris [i], NULL, NULL);
+		rank   = -1;
 
-			rank = atoi (& groups [i] [5]);
+		for (j = 0; groups && groups [j]; ++j) {
+			if (g_str_has_prefix (groups [j], "rank-")) {
+				if (rank >= 0)
+					g_warning (
+						"store corruption - multiple ranks for same uri: [%s] [%s]",
+						priv->store_path, uris [i]);
+
+				rank = atoi (& groups [j] [5]);
+			}
 		}
-	}
 
-	g_strfreev (groups);
+		if (rank >= 0)
+			g_hash_table_insert (priv->ranks, g_strdup (uris [i]), GINT_TO_POINTER (rank));
 
-	return rank;
+		g_strfreev (groups);
+	}
+
+	g_strfreev (uris);
 }
 
 static void
-set_rank (BookmarkAgent *this, const gchar *uri, gint rank)
+write_rank_index (BookmarkAgent *this)
 {
 	BookmarkAgentPrivate *priv = bookmark_agent_get_instance_private (this);
 
-	gchar **groups;
-	gchar  *group;
+	gchar  **uris;
+	gchar  **groups;
+	gchar   *group;
+	gpointer rank;
 
-	gint i;
+	gint i, j;
 
 
-	if (! (priv->reorderable && bookmark_agent_has_item (this, uri)))
+	if (! priv->reorderable)
 		return;
 
-	groups = g_bookmark_file_get_groups (priv->store, uri, NULL, NULL);
+	uris = g_bookmark_file_get_uris (priv->store, NULL);
 
-	for (i = 0; groups && groups [i]; ++i)
-		if (g_str_has_prefix (groups [i], "rank-"))
-			g_bookmark_file_remove_group (priv->store, uri, groups [i], NULL);
+	for (i = 0; uris && uris [i]; ++i) {
+		groups = g_bookmark_file_get_groups (priv->store, uris [i], NULL, NULL);
+
+		for (j = 0; groups && groups [j]; ++j)
+			if (g_str_has_prefix (groups [j], "rank-"))
+				g_bookmark_file_remove_group (priv->store, uris [i], groups [j], NULL);
+
+		g_strfreev (groups);
+
+		if (g_hash_table_lookup_extended (priv->ranks, uris [i], NULL, & rank)) {
+			group = g_strdup_printf ("rank-%d", GPOINTER_TO_INT (rank));
+			g_bookmark_file_add_group (priv->store, uris [i], group);
+			g_free (group);
+		}
+	}
+
+	g_strfreev (uris);
+}
+
+static gint
+get_rank (BookmarkAgent *this, const gchar *uri)
+{
+	BookmarkAgentPrivate *priv = bookmark_agent_get_instance_private (this);
+
+	gpointer rank;
+
+
+	if (! priv->reorderable)
+		return -1;
+
+	if (! g_hash_table_lookup_extended (priv->ranks, uri, NULL, & rank))
+		return -1;
+
+	return GPOINTER_TO_INT (rank);
+}
+
+static void
+set_rank (BookmarkAgent *this, const gchar *uri, gint rank)
+{
+	BookmarkAgentPrivate *priv = bookmark_agent_get_instance_private (this);
 
-	g_strfreev (groups);
 
-	group = g_strdup_printf ("rank-%d", rank);
-	g_bookmark_file_add_group (priv->store, uri, group);
-	g_free (group);
+	if (! (priv->reorderable && bookmark_agent_has_item (this, uri)))
+		return;
+
+	g_hash_table_insert (priv->ranks, g_strdup (uri), GINT_TO_POINTER (rank));
 }
 
 static void
@@ -1024,6 +1129,27 @@ update_user_spec_path (BookmarkAgent *this)
 		g_free (path);
 }
 
+static gchar *
+get_store_etag (const gchar *path)
+{
+	GFile     *file;
+	GFileInfo *info;
+	gchar     *etag = NULL;
+
+
+	file = g_file_new_for_path (path);
+	info = g_file_query_info (file, G_FILE_ATTRIBUTE_ETAG_VALUE, G_FILE_QUERY_INFO_NONE, NULL, NULL);
+
+	if (info) {
+		etag = g_strdup (g_file_info_get_etag (info));
+		g_object_unref (info);
+	}
+
+	g_object_unref (file);
+
+	return etag;
+}
+
 static void
 save_xbel_store (BookmarkAgent *this)
 {
@@ -1031,8 +1157,14 @@ save_xbel_store (BookmarkAgent *this)
 
 	GError *error = NULL;
 
-	if (g_bookmark_file_to_file (priv->store, priv->store_path, &error))
+	/* g_bookmark_file_to_file () writes to a temporary file and renames it over the store */
+	if (g_bookmark_file_to_file (priv->store, priv->store_path, &error)) {
+		/* remembered so that the monitor events caused by this write can be told apart */
+		g_free (priv->saved_etag);
+		priv->saved_etag = get_store_etag (priv->store_path);
+
 		return;
+	}
 
 	if (error) {
 		g_warning ("Couldn't save bookmark file [%s]: %s", priv->store_path, error->message);
@@ -1218,7 +1350,35 @@ static void
 store_monitor_cb (GFileMonitor *mon, GFile *f1, GFile *f2,
                   GFileMonitorEvent event_type, gpointer user_data)
 {
-	update_agent (BOOKMARK_AGENT (user_data));
+	BookmarkAgent        *this = BOOKMARK_AGENT (user_data);
+	BookmarkAgentPrivate *priv = bookmark_agent_get_instance_private (this);
+
+	gchar    *path;
+	gchar    *etag;
+	gboolean  own_write = FALSE;
+
+
+	if (priv->saved_etag && event_type != G_FILE_MONITOR_EVENT_DELETED) {
+		path = g_file_get_path (f1);
+
+		if (! libslab_strcmp (path, priv->store_path)) {
+			etag = get_store_etag (path);
+			own_write = ! libslab_strcmp (etag, priv->saved_etag);
+			g_free (etag);
+		}
+
+		g_free (path);
+	}
+
+	/* the store already has what we wrote ourselves */
+	if (own_write)
+		return;
+
+	/* a change of ours that is still waiting to be written would be lost by the reload */
+	if (priv->save_source_id)
+		flush_store (this);
+
+	update_agent (this);
 }
 
 static void
@@ -80,3 +80,283 @@ load_image_by_id (CtkImage *image, CtkIconSize size, const gchar *image_id)
 
 	return icon_exists;
 }
+
+/* Icons loaded by load_image_by_id_async (), shared by all the images in the process and
+   keyed on the icon id, icon size and scale factor */
+
+#define ICON_CACHE_ENTRY_KEY "cafe-utils-icon-cache-entry"
+
+typedef struct
+{
+	gchar *key;
+	CtkIconSize size;
+	gint scale_factor;
+
+	cairo_surface_t *surface;	/* NULL if the icon could not be loaded */
+	gboolean loaded;
+	gboolean stale;			/* dropped from the cache while still loading */
+	GSList *waiting_images;
+} IconCacheEntry;
+
+typedef struct
+{
+	gchar *path;
+	gint width;
+	gint height;
+} PixbufRequest;
+
+static GHashTable *icon_cache = NULL;
+
+/* Blank surfaces keyed on icon size and scale factor, kept apart from icon_cache so that
+   no icon id can ever collide with them */
+static GHashTable *placeholder_cache = NULL;
+
+static void
+icon_cache_entry_free (IconCacheEntry *entry)
+{
+	if (entry->surface)
+		cairo_surface_destroy (entry->surface);
+	g_free (entry->key);
+	g_free (entry);
+}
+
+static gboolean
+icon_cache_drop_entry (gpointer key, gpointer value, gpointer user_data)
+{
+	IconCacheEntry *entry = (IconCacheEntry *) value;
+
+	/* entries still loading are freed once their images got the result */
+	if (entry->loaded)
+		icon_cache_entry_free (entry);
+	else
+		entry->stale = TRUE;
+
+	return TRUE;
+}
+
+static void
+icon_theme_changed_cb (CtkIconTheme *icon_theme, gpointer user_data)
+{
+	g_hash_table_foreach_remove (icon_cache, icon_cache_drop_entry, NULL);
+}
+
+static void
+set_image_from_entry (CtkImage *image, IconCacheEntry *entry)
+{
+	if (entry->surface)
+		ctk_image_set_from_surface (image, entry->surface);
+	else
+		ctk_image_set_from_icon_name (image, "image-missing", entry->size);
+}
+
+static void
+icon_cache_entry_loaded (IconCacheEntry *entry, cairo_surface_t *surface)
+{
+	GSList *l;
+
+	entry->surface = surface;
+	entry->loaded = TRUE;
+
+	for (l = entry->waiting_images; l; l = l->next)
+	{
+		CtkImage *image = CTK_IMAGE (l->data);
+
+		/* the image may have asked for another icon in the meantime */
+		if (g_object_get_data (G_OBJECT (image), ICON_CACHE_ENTRY_KEY) == entry)
+		{
+			set_image_from_entry (image, entry);
+			g_object_set_data (G_OBJECT (image), ICON_CACHE_ENTRY_KEY, NULL);
+		}
+
+		g_object_unref (image);
+	}
+
+	g_slist_free (entry->waiting_images);
+	entry->waiting_images = NULL;
+
+	if (entry->stale)
+		icon_cache_entry_free (entry);
+}
+
+static void
+icon_load_done (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	IconCacheEntry *entry = (IconCacheEntry *) user_data;
+	GdkPixbuf *pixbuf;
+	cairo_surface_t *surface = NULL;
+
+	if (CTK_IS_ICON_INFO (source))
+		pixbuf = ctk_icon_info_load_icon_finish (CTK_ICON_INFO (source), result, NULL);
+	else
+		pixbuf = g_task_propagate_pointer (G_TASK (result), NULL);
+
+	if (pixbuf)
+	{
+		surface = cdk_cairo_surface_create_from_pixbuf (pixbuf, entry->scale_factor, NULL);
+		g_object_unref (pixbuf);
+	}
+
+	icon_cache_entry_loaded (entry, surface);
+}
+
+static void
+pixbuf_request_free (PixbufRequest *request)
+{
+	g_free (request->path);
+	g_free (request);
+}
+
+static void
+load_pixbuf_thread (GTask *task, gpointer source, gpointer task_data, GCancellable *cancellable)
+{
+	PixbufRequest *request = (PixbufRequest *) task_data;
+	GdkPixbuf *pixbuf;
+
+	pixbuf = gdk_pixbuf_new_from_file_at_size (request->path, request->width, request->height,
+		NULL);
+
+	g_task_return_pointer (task, pixbuf, pixbuf ? g_object_unref : NULL);
+}
+
+static void
+start_icon_load (IconCacheEntry *entry, CtkImage *image, const gchar *image_id,
+	gint width, gint height)
+{
+	if (g_path_is_absolute (image_id))
+	{
+		PixbufRequest *request;
+		GTask *task;
+
+		request = g_new0 (PixbufRequest, 1);
+		request->path = g_strdup (image_id);
+		request->width = width * entry->scale_factor;
+		request->height = height * entry->scale_factor;
+
+		task = g_task_new (NULL, NULL, icon_load_done, entry);
+		g_task_set_task_data (task, request, (GDestroyNotify) pixbuf_request_free);
+		g_task_run_in_thread (task, load_pixbuf_thread);
+		g_object_unref (task);
+	}
+	else
+	{
+		CtkIconTheme *icon_theme;
+		CtkIconInfo *icon_info;
+		gchar *id = g_strdup (image_id);
+
+		/* file extensions are not copesetic with loading by "name" */
+		if (g_str_has_suffix (id, ".png") ||
+			g_str_has_suffix (id, ".svg") ||
+			g_str_has_suffix (id, ".xpm"))
+			id[strlen (id) - 4] = '\0';
+
+		if (ctk_widget_has_screen (CTK_WIDGET (image)))
+			icon_theme = ctk_icon_theme_get_for_screen (ctk_widget_get_screen (CTK_WIDGET (image)));
+		else
+			icon_theme = ctk_icon_theme_get_default ();
+
+		/* the lookup only walks the theme index, the rasterising is done in a thread */
+		icon_info = ctk_icon_theme_lookup_icon_for_scale (icon_theme, id, width,
+			entry->scale_factor, CTK_ICON_LOOKUP_FORCE_SIZE);
+		g_free (id);
+
+		if (!icon_info)
+		{
+			icon_cache_entry_loaded (entry, NULL);
+			return;
+		}
+
+		ctk_icon_info_load_icon_async (icon_info, NULL, icon_load_done, entry);
+		g_object_unref (icon_info);
+	}
+}
+
+/* A transparent surface of the icon size, shown while the icon is loading so that the
+   image does not change size when it arrives */
+static IconCacheEntry *
+get_placeholder_entry (CtkIconSize size, gint width, gint height, gint scale_factor)
+{
+	IconCacheEntry *entry;
+	gchar *key;
+
+	if (!placeholder_cache)
+		placeholder_cache = g_hash_table_new (g_str_hash, g_str_equal);
+
+	key = g_strdup_printf ("%d\n%d", size, scale_factor);
+	entry = g_hash_table_lookup (placeholder_cache, key);
+	if (entry)
+	{
+		g_free (key);
+		return entry;
+	}
+
+	entry = g_new0 (IconCacheEntry, 1);
+	entry->key = key;
+	entry->size = size;
+	entry->scale_factor = scale_factor;
+	entry->surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32,
+		width * scale_factor, height * scale_factor);
+	cairo_surface_set_device_scale (entry->surface, scale_factor, scale_factor);
+	entry->loaded = TRUE;
+	g_hash_table_insert (placeholder_cache, entry->key, entry);
+
+	return entry;
+}
+
+gboolean
+load_image_by_id_async (CtkImage *image, CtkIconSize size, const gchar *image_id)
+{
+	IconCacheEntry *entry;
+	gint width;
+	gint height;
+	gint scale_factor;
+	gchar *key;
+
+	if (!image_id || !image_id[0])
+		return FALSE;
+
+	scale_factor = ctk_widget_get_scale_factor (CTK_WIDGET (image));
+
+	ctk_icon_size_lookup (size, &width, &height);
+	ctk_image_set_pixel_size (image, width);
+
+	if (!icon_cache)
+	{
+		icon_cache = g_hash_table_new (g_str_hash, g_str_equal);
+		g_signal_connect (ctk_icon_theme_get_default (), "changed",
+			G_CALLBACK (icon_theme_changed_cb), NULL);
+	}
+
+	key = g_strdup_printf ("%s\n%d\n%d", image_id, size, scale_factor);
+	entry = g_hash_table_lookup (icon_cache, key);
+	if (entry)
+		g_free (key);
+	else
+	{
+		entry = g_new0 (IconCacheEntry, 1);
+		entry->key = key;
+		entry->size = size;
+		entry->scale_factor = scale_factor;
+		g_hash_table_insert (icon_cache, entry->key, entry);
+
+		start_icon_load (entry, image, image_id, width, height);
+	}
+
+	if (entry->loaded)
+	{
+		g_object_set_data (G_OBJECT (image), ICON_CACHE_ENTRY_KEY, NULL);
+		set_image_from_entry (image, entry);
+
+		return entry->surface != NULL;
+	}
+
+	/* the image may already be waiting for this load */
+	if (g_object_get_data (G_OBJECT (image), ICON_CACHE_ENTRY_KEY) != entry)
+	{
+		g_object_set_data (G_OBJECT (image), ICON_CACHE_ENTRY_KEY, entry);
+		entry->waiting_images = g_slist_prepend (entry->waiting_images, g_object_ref (image));
+	}
+
+	set_image_from_entry (image, get_placeholder_entry (size, width, height, scale_factor));
+
+	return FALSE;
+}
@@ -30,6 +30,14 @@ extern "C" {
 gboolean load_image_by_id (CtkImage * image, CtkIconSize size,
 	const gchar * image_id);
 
+/* Like load_image_by_id (), but shows a blank image of the right size until the icon is
+   loaded off the main thread. Icons are cached per id, size and scale factor, so images
+   asking for an icon that is already loaded get it right away. Returns TRUE only if the
+   icon is already loaded; FALSE while it is loading, if it could not be found, or for a
+   NULL or empty id. */
+gboolean load_image_by_id_async (CtkImage * image, CtkIconSize size,
+	const gchar * image_id);
+
 #ifdef __cplusplus
 }
 #endif
@@ -145,7 +145,7 @@ themed_icon_show (CtkWidget * widget)
 	ThemedIconPrivate *priv = themed_icon_get_instance_private (icon);
 
 	if (!priv->icon_loaded)
-		priv->icon_loaded = load_image_by_id (CTK_IMAGE (icon), icon->size, icon->id);
+		priv->icon_loaded = load_image_by_id_async (CTK_IMAGE (icon), icon->size, icon->id);
 
 	(*CTK_WIDGET_CLASS (themed_icon_parent_class)->show) (widget);
 }
@@ -154,6 +154,8 @@ static void
 themed_icon_style_updated (CtkWidget * widget)
 {
 	ThemedIcon *icon = THEMED_ICON (widget);
+	ThemedIconPrivate *priv = themed_icon_get_instance_private (icon);
 
-	load_image_by_id (CTK_IMAGE (icon), icon->size, icon->id);
+	/* stays FALSE while loading or if the icon is missing, so the next show asks again */
+	priv->icon_loaded = load_image_by_id_async (CTK_IMAGE (icon), icon->size, icon->id);
 }
@@ -33,6 +33,13 @@ static GSList* get_actions_list();
 #define CONTROL_CENTER_ACTIONS_SEPARATOR ";"
 #define EXIT_SHELL_ON_STATIC_ACTION "cc-exit-shell-on-static-action"
 
+static gboolean hidden = FALSE;
+static gboolean resident = FALSE;
+
+/* built on the first activation, and kept for the later ones when running resident */
+static AppShellData* shell_data = NULL;
+static gint64 activate_time;
+
 static GSList* get_actions_list(void)
 {
 	GSettings *settings;
@@ -120,30 +127,54 @@ void handle_static_action_clicked(Tile* tile, TileEvent* event, gpointer data)
 	g_object_unref(settings);
 }
 
+static gboolean
+shell_visible_cb (CtkWidget* widget, cairo_t* cr, gpointer data)
+{
+	g_signal_handlers_disconnect_by_func (widget, shell_visible_cb, data);
+	g_debug ("shell visible %.1f ms after activation",
+		(g_get_monotonic_time () - activate_time) / 1000.0);
+
+	return FALSE;
+}
+
 static void
 activate (CtkApplication *app)
 {
-	GList *list;
 	GSList* actions;
-	gboolean hidden = FALSE;
 
-	list = ctk_application_get_windows (app);
+	activate_time = g_get_monotonic_time ();
+
+	if (shell_data)
+	{
+		/* everything is still there from the first activation, only show it again */
+		if (!ctk_widget_get_visible (shell_data->main_app))
+		{
+			g_signal_connect (shell_data->main_app, "draw", G_CALLBACK (shell_visible_cb), NULL);
+			show_shell (shell_data);
+		}
+
+		ctk_window_present (CTK_WINDOW (shell_data->main_app));
+		return;
+	}
 
-	AppShellData* app_data = appshelldata_new("cafecc.menu", CTK_ICON_SIZE_DND, FALSE, TRUE, 0);
+	/* a resident shell is only hidden when closed, so the next activation is instant */
+	shell_data = appshelldata_new("cafecc.menu", CTK_ICON_SIZE_DND, FALSE, !resident, 0);
 
-	generate_categories(app_data);
+	generate_categories(shell_data);
 
 	actions = get_actions_list();
-	layout_shell(app_data, _("Filter"), _("Groups"), _("Common Tasks"), actions, handle_static_action_clicked);
+	layout_shell(shell_data, _("Filter"), _("Groups"), _("Common Tasks"), actions, handle_static_action_clicked);
 
-	if (list)
-	{
-		ctk_window_present (CTK_WINDOW (list->data));
-	}
-	else
+	create_main_window(shell_data, "MyControlCenter", _("Control Center"), "preferences-desktop", 975, 600, TRUE);
+	ctk_application_add_window (app, CTK_WINDOW(shell_data->main_app));
+
+	if (resident)
+		g_application_hold (G_APPLICATION (app));
+
+	if (!hidden)
 	{
-		create_main_window(app_data, "MyControlCenter", _("Control Center"), "preferences-desktop", 975, 600, hidden);
-		ctk_application_add_window (app, CTK_WINDOW(app_data->main_app));
+		g_signal_connect (shell_data->main_app, "draw", G_CALLBACK (shell_visible_cb), NULL);
+		show_shell (shell_data);
 	}
 }
 
@@ -155,13 +186,13 @@ quit (GApplication *app)
 
 int main(int argc, char* argv[])
 {
-	gboolean hidden = FALSE;
 	CtkApplication *app;
 	gint retval;
 	app = ctk_application_new ("org.cafe.cafe-control-center.shell", 0);
 	GError* error;
 	GOptionEntry options[] = {
 		{"hide", 0, 0, G_OPTION_ARG_NONE, &hidden, N_("Hide on start (useful to preload the shell)"), NULL},
+		{"resident", 0, 0, G_OPTION_ARG_NONE, &resident, N_("Keep running when the window is closed, so that it opens again instantly"), NULL},
 		{NULL}
 	};
 
@@ -180,6 +211,10 @@ int main(int argc, char* argv[])
 		return 1;
 	}
 
+	/* preloading is only useful if the preloaded shell stays around */
+	if (hidden)
+		resident = TRUE;
+
 	g_signal_connect (app, "activate", G_CALLBACK (activate), NULL);
 	g_signal_connect (app, "window-removed", G_CALLBACK (quit), NULL);
 	retval = g_application_run (G_APPLICATION (app), argc, argv);